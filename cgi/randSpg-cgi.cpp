@@ -142,7 +142,9 @@ char **getcgivars() {
 #include <iostream>
 
 #include "elemInfo.h"
+#include "generationPlan.h"
 #include "randSpg.h"
+#include "randSpgContext.h"
 #include "randSpgOptions.h"
 #include "utilityFunctions.h"
 
@@ -235,6 +237,10 @@ int main() {
   input.verbosity = options.getVerbosity();
   input.maxAttempts = options.getMaxAttempts();
   input.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+  input.seed = options.getSeed();
+  input.backtrackDepth = options.getBacktrackDepth();
+  input.backtrackRetries = options.getBacktrackRetries();
+  input.placeByDifficulty = options.placeByDifficulty();
 
   // Set up various other options
   vector<uint> spacegroups = options.getSpacegroups();
@@ -287,13 +293,17 @@ int main() {
   // Let's time it!
   auto start_loopWall = std::chrono::high_resolution_clock::now();
 
+  // Every structure uses the same radii, random number stream, and log
+  RandSpgContext context(input);
+
   // Loop through the ones we are going to create
   for (size_t i = 0; i < spacegroups.size(); i++) {
     uint spg = spacegroups.at(i);
     // Change the input spg to have the right spacegroup
     input.spg = spg;
+    GenerationPlan plan = RandSpg::compile(input, context);
     for (size_t j = 0; j < numOfEach; j++) {
-      Crystal c = RandSpg::randSpgCrystal(input);
+      Crystal c = plan.generate(context, j);
 
       // The volume is set to zero if the job failed.
       if (c.getVolume() == 0) {
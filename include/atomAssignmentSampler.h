@@ -0,0 +1,91 @@
+/**********************************************************************
+  atomAssignmentSampler.h - Class for drawing random atom assignments from
+                            the system possibilities of a sampler without
+                            copying them
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef ATOM_ASSIGNMENT_SAMPLER_H
+#define ATOM_ASSIGNMENT_SAMPLER_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "systemPossibilitySampler.h"
+
+/* Draws random atom assignments directly from a SystemPossibilitySampler.
+ *
+ * Drawing them with RandSpgCombinatorics::getRandomAtomAssignments() creates
+ * a system possibility, copies it, and erases every unique position that
+ * gets used from all of its vectors. This class looks up the usage of each
+ * atom type in the sampler instead, and keeps track of the used unique
+ * positions with a bit for each position. After the first draw, drawing does
+ * not allocate any memory, and it only takes time proportional to the
+ * number of atoms that are placed.
+ *
+ * The random numbers that are drawn are the same as those of
+ * SystemPossibilitySampler::getRandomPossibility() followed by
+ * RandSpgCombinatorics::getRandomAtomAssignmentsFromPossibility(), so the
+ * assignments are the same too.
+ *
+ * Each draw uses scratch space in the object, so an object should only be
+ * used by one thread. The sampler must outlive it.
+ */
+class AtomAssignmentSampler {
+ public:
+  /* @param sampler The sampler to draw the system possibilities from.
+   * @param numOfEachType The number of atoms of each atom type and their
+   *                      atomic numbers, in the same order as the atom
+   *                      types of the sampler. The assignments use these
+   *                      atomic numbers, so the samplers of
+   *                      SystemPossibilityCache may be used.
+   * @param forcedWyckPositions Pairs of atomic numbers and Wyckoff positions
+   *                            that are always assigned.
+   */
+  AtomAssignmentSampler(
+    const SystemPossibilitySampler& sampler,
+    const std::vector<numAndType>& numOfEachType,
+    const std::vector<std::pair<uint, wyckHandle>>& forcedWyckPositions);
+
+  /* Pick a random system possibility and random atom assignments from it.
+   *
+   * @param assignments The atom assignments. It is cleared first, and its
+   *                    memory is reused.
+   *
+   * @return False if there are no system possibilities or the assignments
+   *         could not be made.
+   */
+  bool getRandomAtomAssignments(atomAssignments& assignments);
+
+ private:
+  const SystemPossibilitySampler& m_sampler;
+  std::vector<uint> m_atomicNums;
+  std::vector<std::pair<uint, wyckHandle>> m_forced;
+  // The atom type index of each forced position. It is the number of atom
+  // types if the atomic number is not in the composition.
+  std::vector<size_t> m_forcedTypes;
+
+  // The positions of every group, one after the other, and where each
+  // group starts. The group at index i is in [m_groupStart[i],
+  // m_groupStart[i + 1]).
+  std::vector<wyckHandle> m_positions;
+  std::vector<size_t> m_groupStart;
+
+  // Scratch space for each draw
+  std::vector<size_t> m_choices;
+  std::vector<uint64_t> m_states;
+  std::vector<uint> m_numToChoose;
+};
+
+#endif
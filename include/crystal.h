@@ -18,8 +18,14 @@
 #define CRYSTAL_H
 
 #include <cstdlib>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "iadKernels.h"
+#include "minIADTable.h"
+#include "positionHash.h"
+
 // For some reason, uint isn't always defined on windows...
 #ifdef _WIN32
 #ifndef UNSIGNEDINT
@@ -82,7 +88,7 @@ class Crystal {
    *
    * @param a The new vector of atoms.
    */
-  void setAtoms(std::vector<atomStruct> a) {m_atoms = a;};
+  void setAtoms(std::vector<atomStruct> a) {m_atoms = a; invalidateAtomCaches();};
 
   /* Get a vector of the atom structs in this crystal.
    *
@@ -131,7 +137,14 @@ class Crystal {
    *
    * @param atom The atom to be added.
    */
-  void addAtom(atomStruct atom) {m_atoms.push_back(atom);};
+  void addAtom(atomStruct atom)
+  {
+    m_atoms.push_back(atom);
+    if (m_cellListBuilt) addToCellList(m_atoms.size() - 1);
+    if (m_atomArraysBuilt) addToAtomArrays(atom);
+    if (m_positionHashBuilt)
+      m_positionHash.insert(atom.x, atom.y, atom.z, m_atoms.size() - 1);
+  };
 
   /* Checks to see if an atom is already at the position given by 'as'. Adds an
    * atom if one is not.
@@ -192,6 +205,21 @@ class Crystal {
    */
   bool fillCellWithAtom(uint spg, const atomStruct& as);
 
+  /* Add an atom and its duplications required by a spacegroup, but only if
+   * none of them fail the IAD checks. The same atoms are added as with
+   * addAtom() followed by fillCellWithAtom(). However, the whole orbit is
+   * generated and checked in a scratch buffer first, so the crystal is
+   * not modified at all if the IAD checks fail.
+   *
+   * @param spg The spacegroup for which to duplicate the atom.
+   * @param as The atom which we wish to add. It should not already be
+   *           present in the cell.
+   *
+   * @return true if the atom and its duplications were added. False if
+   *         they failed the IAD checks and nothing was added.
+   */
+  bool addAtomAndOrbitIfIADsAreOkay(uint spg, const atomStruct& as);
+
   /* Calls fillCellWithAtom() for every atom that is currently in the cell.
    *
    * @return false if any of these return false.
@@ -242,11 +270,38 @@ class Crystal {
    */
   double getDistance(const atomStruct& as1, const atomStruct& as2) const;
 
+  /* Get the distance between two atoms using the minimum image convention.
+   * That is, the distance between as1 and the closest periodic image of as2.
+   *
+   * @param as1 The first atom.
+   * @param as2 The second atom.
+   *
+   * @return The minimum-image distance in Angstroms between the two atoms.
+   */
+  double getMinImageDistance(const atomStruct& as1,
+                             const atomStruct& as2) const;
+
+  /* Get the squared minimum-image distance for a difference in fractional
+   * coordinates. The images are searched along a reduced basis of the
+   * lattice, and only the images that could be closer than 'cutoff' are
+   * visited. If no image is closer than the cutoff, the returned value may
+   * not be the minimum, but it will be at least the cutoff squared.
+   *
+   * @param dx The difference in the fractional x coordinates.
+   * @param dy The difference in the fractional y coordinates.
+   * @param dz The difference in the fractional z coordinates.
+   * @param cutoff The cutoff in Angstroms. If it is negative, the true
+   *               minimum is found.
+   *
+   * @return The squared minimum-image distance in Angstroms squared.
+   */
+  double getMinImageDistanceSquared(double dx, double dy, double dz,
+                                    double cutoff = -1.0) const;
+
   /* Find the nearest atom to parameter 'as' and set that neighbor to parameter
    * 'neighbor'. It also returns the distance between them in Angstroms.
-   * In order to take into account periodicity effects, it creates a temporary
-   * cell in which 'as' is at the center and finds all distances from there.
-   * Note: function may not work if 'as' is closest to itself in another cell...
+   * Distances are minimum-image distances. 'as' itself (including its
+   * periodic images) is not considered to be a neighbor.
    *
    * @param as The atomstruct for which to find the nearest neighbor. It should
    *           already be an atom present in the crystal.
@@ -284,6 +339,28 @@ class Crystal {
    */
   double getMinIAD(const atomStruct& as1, const atomStruct& as2) const;
 
+  /* Use a precomputed table of minIADs for the IAD checks instead of
+   * looking them up in ElemInfo. Atom types that are not in the table are
+   * still looked up in ElemInfo. The table may be shared between crystals.
+   *
+   * @param table The table to use. A null pointer (the default) means that
+   *              ElemInfo is used for every lookup.
+   */
+  void setMinIADTable(const std::shared_ptr<const MinIADTable>& table)
+  {
+    m_minIADTable = table;
+    m_atomArraysBuilt = false;
+  };
+
+  /* Get the table of minIADs used by this crystal.
+   *
+   * @return The table. It may be a null pointer.
+   */
+  std::shared_ptr<const MinIADTable> getMinIADTable() const
+  {
+    return m_minIADTable;
+  };
+
   /* Calls areIADsOkay(const atomStruct&) for every atom in the cell.
    *
    * @return true if all IADs are okay. False if not.
@@ -299,6 +376,28 @@ class Crystal {
    */
   bool areIADsOkay(const atomStruct& as) const;
 
+  /* Use a cell list for interatomic distance checks. The cell is divided
+   * into bins that are at least 'cutoff' wide, and the bins are kept up to
+   * date as atoms are added and removed. An IAD check then only has to look
+   * at the atoms in the 27 bins around the atom being checked. If the cell
+   * is too small to have at least 3 bins along every axis, all atoms are
+   * checked as usual.
+   *
+   * @param cutoff The largest minIAD that will be checked. A cutoff of zero
+   *               (the default) disables the cell list.
+   */
+  void setCellListCutoff(double cutoff)
+  {
+    m_cellListCutoff = cutoff;
+    m_cellListBuilt = false;
+  };
+
+  /* Get the cutoff of the cell list. Zero means it is disabled.
+   *
+   * @return The cutoff of the cell list in Angstroms.
+   */
+  double getCellListCutoff() const {return m_cellListCutoff;};
+
   /* Find the index number of an atom in the cell.
    *
    * @param as The atom for which to find an index number.
@@ -381,12 +480,83 @@ class Crystal {
     m_unitVolume = -1.0;
     m_volume = -1.0;
     m_cartConvMatCached = false;
+    m_cellListBuilt = false;
   };
 
   // Cache the cartesian conversion matrix
   void cacheCartConvMat() const;
-
  private:
+  // Invalidate everything that is derived from the atoms
+  void invalidateAtomCaches()
+  {
+    m_cellListBuilt = false;
+    m_atomArraysBuilt = false;
+    m_positionHashBuilt = false;
+  };
+
+  // Builds the hash of the atom positions if it has not been built yet
+  void buildPositionHash() const;
+
+  // Whether an atom of the same type is already at the position of 'as'
+  bool isPositionTaken(const atomStruct& as) const;
+
+  // Builds the structure-of-arrays copy of the atoms if it has not been
+  // built yet
+  void buildAtomArrays() const;
+
+  // Appends an atom to the structure-of-arrays copy of the atoms
+  void addToAtomArrays(const atomStruct& as) const;
+
+  // Whether the IADs of an atom may be checked with the vectorized kernel
+  bool canUseIADKernel(const atomStruct& as) const;
+
+  // Checks the IADs of an atom against every atom in the crystal except
+  // the one at index 'skip'. The atom does not need to be in the crystal.
+  // If it is not, 'skip' should be m_atoms.size().
+  bool areIADsOkay(const atomStruct& as, size_t skip) const;
+
+  // Same as above, but using the vectorized kernel
+  bool areIADsOkayUsingKernel(const atomStruct& as, size_t skip) const;
+
+  // Cache the reduced basis. Called by cacheCartConvMat().
+  void cacheReducedBasis() const;
+
+  // Builds the cell list if it is enabled and has not been built yet.
+  // Returns true if the cell list may be used.
+  bool buildCellList() const;
+
+  // Adds the atom at index i to the cell list
+  void addToCellList(size_t i) const;
+
+  // The index of the bin in the cell list that contains an atom
+  size_t getCellListBinIndex(const atomStruct& as) const;
+
+  // Same as areIADsOkay(as, skip), but using the cell list
+  bool areIADsOkayUsingCellList(const atomStruct& as, size_t skip) const;
+
+  // The row of squared minIADs in the table for the type of an atom, or a
+  // null pointer if it is not in the table
+  const double* getMinIADsSquaredRow(const atomStruct& as) const
+  {
+    if (!m_minIADTable) return nullptr;
+    int typeIndex = m_minIADTable->getTypeIndex(as.atomicNum);
+    if (typeIndex == -1) return nullptr;
+    return m_minIADTable->getMinIADsSquaredRow(typeIndex);
+  };
+
+  // The squared minIAD between two atoms. 'row' is the result of
+  // getMinIADsSquaredRow(as1).
+  double getMinIADSquared(const atomStruct& as1, const atomStruct& as2,
+                          const double* row) const
+  {
+    if (row) {
+      int typeIndex = m_minIADTable->getTypeIndex(as2.atomicNum);
+      if (typeIndex != -1) return row[typeIndex];
+    }
+    double minIAD = getMinIAD(as1, as2);
+    return minIAD * minIAD;
+  };
+
   latticeStruct m_lattice;
   std::vector<atomStruct> m_atoms;
 
@@ -407,6 +577,53 @@ class Crystal {
   // [2][2] is [5]
   mutable bool m_cartConvMatCached;
   mutable double m_cartConvMat[6];
+
+  // The distances between the lattice planes spanned by each pair of lattice
+  // vectors. m_cellHeights[i] is the height along lattice vector i. It is
+  // cached along with the cartesian conversion matrix.
+  mutable double m_cellHeights[3];
+
+  // A reduced basis of the lattice for minimum-image distances. It is cached
+  // along with the cartesian conversion matrix. m_reducedBasis[i] is the ith
+  // reduced lattice vector in cartesian coordinates, m_reducedBasisInv is
+  // the inverse (its rows are the reciprocal vectors), and m_reducedHeights
+  // are the distances between the lattice planes of the reduced basis.
+  mutable double m_reducedBasis[3][3];
+  mutable double m_reducedBasisInv[3][3];
+  mutable double m_reducedHeights[3];
+
+  // The cell list. Each bin contains the indices of the atoms in it.
+  // It is built when it is first needed and is invalidated whenever the
+  // lattice changes or atoms are moved.
+  double m_cellListCutoff;
+  mutable bool m_cellListBuilt;
+  mutable int m_cellListDims[3];
+  mutable std::vector<std::vector<uint>> m_cellList;
+
+  // The minIADs for the IAD checks. ElemInfo is used if this is null.
+  std::shared_ptr<const MinIADTable> m_minIADTable;
+
+  // A structure-of-arrays copy of the atoms for the vectorized IAD checks.
+  // The types are the type indices in m_minIADTable (-1 if not present).
+  // Like the cell list, it is built when it is first needed and is kept up
+  // to date as atoms are appended to and removed from the end.
+  mutable bool m_atomArraysBuilt;
+  mutable std::vector<double> m_atomsX;
+  mutable std::vector<double> m_atomsY;
+  mutable std::vector<double> m_atomsZ;
+  mutable std::vector<int> m_atomTypes;
+  mutable size_t m_numAtomsWithUnknownType;
+
+  // A hash of the atom positions for finding duplicate atoms. Like the
+  // cell list, it is built when it is first needed and is kept up to date
+  // as atoms are appended to and removed from the end.
+  mutable bool m_positionHashBuilt;
+  mutable PositionHash m_positionHash;
+
+  // Scratch buffer for addAtomAndOrbitIfIADsAreOkay() so that it does not
+  // need to allocate for every attempt, and the hash of its positions
+  std::vector<atomStruct> m_orbitScratch;
+  PositionHash m_orbitHash;
 };
 
 #endif
@@ -0,0 +1,125 @@
+/**********************************************************************
+  generationPlan.h - Class that holds everything about a randSpgInput that
+                     does not change between the crystals generated from it
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef GENERATION_PLAN_H
+#define GENERATION_PLAN_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crystal.h"
+#include "minIADTable.h"
+#include "randSpg.h"
+#include "systemPossibilitySampler.h"
+
+class RandSpgContext;
+
+/* A randSpgInput that has been prepared for generation. RandSpg::compile()
+ * creates one. It finds the system possibility sampler, the forced Wyckoff
+ * positions, and the minIAD table of the input once, and checks that the
+ * spacegroup can be generated. After that, generate() only has to pick
+ * lattices and place atoms.
+ *
+ * The symmetry operations and compiled Wyckoff coordinates are compiled
+ * once per process already, so they are not stored here.
+ *
+ * A plan is never modified after it is built, so one plan may be used by
+ * several threads at once, as long as each thread has its own context.
+ */
+class GenerationPlan {
+ public:
+  /* Prepare an input for generation. Use RandSpg::compile() instead of
+   * calling this directly.
+   *
+   * @param input The input.
+   * @param context The context whose radii and custom minIADs are used for
+   *                the minIAD table.
+   */
+  GenerationPlan(const randSpgInput& input, const RandSpgContext& context);
+
+  /* @return False if the spacegroup cannot be generated with this input.
+   *         The reason was printed when the plan was built. generate()
+   *         only returns empty crystals in that case.
+   */
+  bool isValid() const {return m_valid;};
+
+  /* @return The input that this plan was built from.
+   */
+  const randSpgInput& getInput() const {return m_input;};
+
+  /* @return The number of system possibilities of the input.
+   */
+  double getNumPossibilities() const;
+
+  /* Generate a crystal. The random number stream and log of the context are
+   * used.
+   *
+   * @param context The context. Unseeded generations advance its random
+   *                number stream.
+   * @param structureIndex The index of this structure in a batch. If the
+   *                       input has a seed, it selects the random stream of
+   *                       the structure.
+   *
+   * @return The crystal, or a Crystal with zero volume on failure.
+   */
+  Crystal generate(RandSpgContext& context, uint structureIndex) const;
+
+  /* Generate a crystal with the structure index of the input.
+   *
+   * @param context The context.
+   *
+   * @return The crystal, or a Crystal with zero volume on failure.
+   */
+  Crystal generate(RandSpgContext& context) const
+  {
+    return generate(context, m_input.structureIndex);
+  };
+
+  /* Generate several crystals. Their structure indices start at the
+   * structure index of the input.
+   *
+   * @param n The number of crystals to generate.
+   * @param context The context.
+   *
+   * @return The crystals. The ones that failed have zero volume.
+   */
+  std::vector<Crystal> generate(size_t n, RandSpgContext& context) const;
+
+  /* Generate several crystals with a context built from the input. Unseeded
+   * generations continue the random number stream of the calling thread,
+   * like RandSpg::randSpgCrystal(input) does.
+   *
+   * @param n The number of crystals to generate.
+   *
+   * @return The crystals. The ones that failed have zero volume.
+   */
+  std::vector<Crystal> generate(size_t n) const;
+
+ private:
+  randSpgInput m_input;
+  bool m_valid;
+  std::vector<numAndType> m_numOfEachType;
+  std::shared_ptr<const SystemPossibilitySampler> m_sampler;
+  std::vector<std::pair<uint, wyckHandle>> m_forcedWyckPositions;
+  std::shared_ptr<const MinIADTable> m_minIADTable;
+  double m_cellListCutoff;
+  // What is written to the log before each crystal if verbosity is 'v'
+  std::string m_possibilitiesLog;
+};
+
+#endif
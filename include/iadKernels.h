@@ -0,0 +1,65 @@
+/**********************************************************************
+  iadKernels.h - Vectorized kernels for checking one atom against many
+                 atoms for interatomic distance failures
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef IAD_KERNELS_H
+#define IAD_KERNELS_H
+
+#include <cstddef>
+
+/* The atoms to check against, stored as a structure of arrays. The
+ * coordinates are fractional and do not need to be wrapped.
+ */
+struct iadKernelAtoms {
+  const double* x;
+  const double* y;
+  const double* z;
+  // The type index of every atom in 'minIADsSquared'
+  const int* types;
+};
+
+/* Checks to see if any atom in [begin, end) is closer to a point than its
+ * minIAD. The fractional differences are wrapped to the nearest image along
+ * each lattice vector. That image is the minimum image for any distance that
+ * is shorter than half of the smallest height of the cell, so this is only
+ * exact when every minIAD is shorter than that.
+ *
+ * The kernel is chosen at runtime: AVX-512 or AVX2 if the CPU supports them,
+ * and a portable scalar loop otherwise.
+ *
+ * @param atoms The atoms to check against.
+ * @param begin The first index to check.
+ * @param end One past the last index to check.
+ * @param pos The fractional coordinates of the point.
+ * @param minIADsSquared The squared minIADs between the point and every
+ *                       atom type, indexed by type index.
+ * @param cartConvMat The cartesian conversion matrix of the cell, in the
+ *                    upper triangular form used by Crystal.
+ *
+ * @return True if any atom is closer than its minIAD. False otherwise.
+ */
+bool isAnyAtomWithinMinIAD(const iadKernelAtoms& atoms,
+                           size_t begin, size_t end,
+                           const double pos[3],
+                           const double* minIADsSquared,
+                           const double cartConvMat[6]);
+
+/* Get the name of the kernel that was chosen for this CPU.
+ *
+ * @return "avx512", "avx2", or "scalar".
+ */
+const char* getIADKernelName();
+
+#endif
@@ -0,0 +1,144 @@
+/**********************************************************************
+  minIADTable.h - Class for a dense table of the minimum interatomic
+                  distances between every pair of atom types in a
+                  composition
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef MIN_IAD_TABLE_H
+#define MIN_IAD_TABLE_H
+
+#include <cstdlib>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// For some reason, uint isn't always defined on windows...
+#ifdef _WIN32
+#ifndef UNSIGNEDINT
+#define UNSIGNEDINT
+typedef unsigned int uint;
+#endif
+#endif
+
+// The minIADs are looked up once, when the table is built, so the IAD
+// checks do not have to search the custom minIAD list and look up radii for
+// every pair of atoms. They come either from ElemInfo or from the radii and
+// custom minIADs of a RandSpgContext. The table is immutable after it is
+// built, so one table may be shared by every crystal of a generation.
+class MinIADTable {
+ public:
+  /* Build the table for the atom types in a composition. Any modifications
+   * to the radii (scaling or setting) and the custom minIADs should be made
+   * in ElemInfo before the table is built.
+   *
+   * @param atoms The atomic numbers of the composition. They may be repeated.
+   * @param usingVdwRadii Whether to use vdw radii instead of covalent radii.
+   */
+  explicit MinIADTable(const std::vector<uint>& atoms,
+                       bool usingVdwRadii = false);
+
+  /* Build the table for the atom types in a composition from a radius for
+   * each atomic number and a list of custom minIADs. ElemInfo is not used.
+   *
+   * @param atoms The atomic numbers of the composition. They may be repeated.
+   * @param radii The radius of each atomic number, indexed by the atomic
+   *              number.
+   * @param customMinIADs Pairs of atomic numbers and their minIAD. These
+   *                      take precedence over the radii.
+   */
+  MinIADTable(const std::vector<uint>& atoms,
+              const std::vector<double>& radii,
+              const std::vector<std::pair<std::pair<uint, uint>, double>>&
+                customMinIADs);
+
+  /* Get the index of an atomic number in the table.
+   *
+   * @param atomicNum The atomic number.
+   *
+   * @return The index of the type, or -1 if the type is not in the table.
+   */
+  int getTypeIndex(uint atomicNum) const
+  {
+    return (atomicNum < m_typeIndices.size()) ? m_typeIndices[atomicNum] : -1;
+  };
+
+  /* Get the number of atom types in the table.
+   *
+   * @return The number of atom types.
+   */
+  size_t numTypes() const {return m_numTypes;};
+
+  /* Get a row of the table of squared minIADs. The row is indexed by the
+   * type index of the second atom.
+   *
+   * @param typeIndex The type index of the first atom.
+   *
+   * @return A pointer to the row.
+   */
+  const double* getMinIADsSquaredRow(int typeIndex) const
+  {
+    return &m_minIADsSquared[typeIndex * m_numTypes];
+  };
+
+  /* Get the squared minIAD between two atom types.
+   *
+   * @param atomicNum1 The atomic number of the first atom.
+   * @param atomicNum2 The atomic number of the second atom.
+   *
+   * @return The squared minIAD in Angstroms squared, or -1.0 if either of
+   *         the types is not in the table.
+   */
+  double getMinIADSquared(uint atomicNum1, uint atomicNum2) const
+  {
+    int i = getTypeIndex(atomicNum1), j = getTypeIndex(atomicNum2);
+    if (i == -1 || j == -1) return -1.0;
+    return m_minIADsSquared[i * m_numTypes + j];
+  };
+
+  /* Get the minIAD between two atom types.
+   *
+   * @param atomicNum1 The atomic number of the first atom.
+   * @param atomicNum2 The atomic number of the second atom.
+   *
+   * @return The minIAD in Angstroms, or -1.0 if either of the types is not
+   *         in the table.
+   */
+  double getMinIAD(uint atomicNum1, uint atomicNum2) const
+  {
+    int i = getTypeIndex(atomicNum1), j = getTypeIndex(atomicNum2);
+    if (i == -1 || j == -1) return -1.0;
+    return m_minIADs[i * m_numTypes + j];
+  };
+
+  /* Get the largest minIAD in the table.
+   *
+   * @return The largest minIAD in Angstroms.
+   */
+  double getLargestMinIAD() const {return m_largestMinIAD;};
+
+ private:
+  // Fills in the table. 'getMinIAD' finds the minIAD of two atomic numbers.
+  void build(const std::vector<uint>& atoms,
+             const std::function<double(uint, uint)>& getMinIAD);
+
+  // Maps atomic numbers to type indices. -1 means that it is not present.
+  std::vector<int> m_typeIndices;
+  size_t m_numTypes;
+  // Both of these are m_numTypes x m_numTypes in row-major order
+  std::vector<double> m_minIADs;
+  std::vector<double> m_minIADsSquared;
+  double m_largestMinIAD;
+};
+
+#endif
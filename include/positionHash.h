@@ -0,0 +1,136 @@
+/**********************************************************************
+  positionHash.h - Class for finding atoms that are at (nearly) the same
+                   fractional coordinates without comparing against every
+                   atom
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef POSITION_HASH_H
+#define POSITION_HASH_H
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+// The fractional coordinates are quantized into buckets that are much wider
+// than the tolerance. A lookup visits the bucket of the position, plus the
+// neighboring buckets along any axis where the position is within the
+// tolerance of the edge of its bucket. So a lookup almost always visits
+// exactly one bucket.
+//
+// The hash only stores indices. The caller decides what the indices refer
+// to and what counts as a match. Coordinates are not wrapped: positions
+// that are equal up to a lattice vector are not considered to be the same.
+// Crystal wraps coordinates that are within the tolerance of 1.0 to 0.0, so
+// images near the boundary still end up next to each other.
+class PositionHash {
+ public:
+  /* @param tolerance Two positions are the same if every coordinate
+   *                  differs by less than this.
+   */
+  explicit PositionHash(double tolerance = 1e-5) :
+    m_tolerance(tolerance),
+    m_bucketWidth(tolerance * 100.0),
+    m_buckets()
+  {}
+
+  void clear() {m_buckets.clear();};
+
+  /* Add an index at a position.
+   *
+   * @param x The fractional x coordinate.
+   * @param y The fractional y coordinate.
+   * @param z The fractional z coordinate.
+   * @param index The index to add.
+   */
+  void insert(double x, double y, double z, size_t index)
+  {
+    m_buckets.insert(std::make_pair(getKey(getBucket(x), getBucket(y),
+                                           getBucket(z)), index));
+  };
+
+  /* Remove an index at a position. The position must be the same as when it
+   * was inserted.
+   *
+   * @param x The fractional x coordinate.
+   * @param y The fractional y coordinate.
+   * @param z The fractional z coordinate.
+   * @param index The index to remove.
+   */
+  void erase(double x, double y, double z, size_t index)
+  {
+    auto range = m_buckets.equal_range(getKey(getBucket(x), getBucket(y),
+                                              getBucket(z)));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == index) {
+        m_buckets.erase(it);
+        return;
+      }
+    }
+  };
+
+  /* Call 'isMatch' for every index that may be within the tolerance of a
+   * position until it returns true. Indices that are further away may be
+   * passed as well, so 'isMatch' needs to check the position itself.
+   *
+   * @param x The fractional x coordinate.
+   * @param y The fractional y coordinate.
+   * @param z The fractional z coordinate.
+   * @param isMatch A function taking an index and returning a bool.
+   *
+   * @return true if 'isMatch' returned true for any index.
+   */
+  template <typename Pred>
+  bool findNear(double x, double y, double z, Pred isMatch) const
+  {
+    int64_t lo[3], hi[3];
+    const double pos[3] = {x, y, z};
+    for (size_t i = 0; i < 3; i++) {
+      lo[i] = getBucket(pos[i] - m_tolerance);
+      hi[i] = getBucket(pos[i] + m_tolerance);
+    }
+
+    for (int64_t i = lo[0]; i <= hi[0]; i++) {
+      for (int64_t j = lo[1]; j <= hi[1]; j++) {
+        for (int64_t k = lo[2]; k <= hi[2]; k++) {
+          auto range = m_buckets.equal_range(getKey(i, j, k));
+          for (auto it = range.first; it != range.second; ++it) {
+            if (isMatch(it->second)) return true;
+          }
+        }
+      }
+    }
+    return false;
+  };
+
+ private:
+  int64_t getBucket(double u) const
+  {
+    return static_cast<int64_t>(std::floor(u / m_bucketWidth));
+  };
+
+  // Different buckets may share a key. That is fine since the caller checks
+  // the positions anyways.
+  static uint64_t getKey(int64_t i, int64_t j, int64_t k)
+  {
+    return static_cast<uint64_t>(i) * 73856093ULL ^
+           static_cast<uint64_t>(j) * 19349663ULL ^
+           static_cast<uint64_t>(k) * 83492791ULL;
+  };
+
+  double m_tolerance;
+  double m_bucketWidth;
+  std::unordered_multimap<uint64_t, size_t> m_buckets;
+};
+
+#endif
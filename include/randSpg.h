@@ -16,6 +16,8 @@
 #ifndef RAND_SPG_H
 #define RAND_SPG_H
 
+#include <bitset>
+#include <cstdint>
 #include <vector>
 #include <tuple>
 #include <utility>
@@ -38,10 +40,17 @@ typedef std::tuple<char, int, std::string, bool> wyckPos;
 // spacegroup will have it's own vector of wyckoff positions.
 typedef std::vector<wyckPos> wyckoffPositions;
 
+// A compact reference to a wyckPos in the database in wyckoffDatabase.h.
+// The spacegroup is in the upper 16 bits and the index of the position in
+// the spacegroup is in the lower 16 bits. The combinatorics and the atom
+// assignments use these so that they never copy the positions (and their
+// strings). Use RandSpg::getWyckPos() to get the position itself.
+typedef uint32_t wyckHandle;
+
 // This assign an atom with a specific atomic number to be placed in a specific
 // wyckoff position
 // 'uint' is the atomic number
-typedef std::pair<wyckPos, uint> atomAssignment;
+typedef std::pair<wyckHandle, uint> atomAssignment;
 // This is a vector of atom assignments
 typedef std::vector<atomAssignment> atomAssignments;
 
@@ -50,6 +59,36 @@ typedef std::pair<uint, uint> numAndType;
 
 typedef std::pair<std::string, std::string> fillCellInfo;
 
+// An affine transformation of fractional coordinates: a 3x3 matrix with the
+// coefficients of x, y, and z for each component, and a translation. The
+// coordinate strings in the databases (like "-x+0.5,y,0.25") are compiled
+// into these once so that they do not have to be parsed every time they
+// are used.
+struct affineTransform {
+  double rot[3][3];
+  double trans[3];
+  affineTransform() : rot{}, trans{} {}
+
+  // Apply the transformation to (x, y, z)
+  void apply(double x, double y, double z,
+             double& newX, double& newY, double& newZ) const
+  {
+    newX = rot[0][0] * x + rot[0][1] * y + rot[0][2] * z + trans[0];
+    newY = rot[1][0] * x + rot[1][1] * y + rot[1][2] * z + trans[1];
+    newZ = rot[2][0] * x + rot[2][1] * y + rot[2][2] * z + trans[2];
+  }
+
+  // The number of the variables x, y, and z that are used
+  unsigned char numVariables() const
+  {
+    unsigned char ret = 0;
+    for (size_t j = 0; j < 3; ++j) {
+      if (rot[0][j] != 0.0 || rot[1][j] != 0.0 || rot[2][j] != 0.0) ++ret;
+    }
+    return ret;
+  }
+};
+
 struct randSpgInput {
   // The space group to be generated. Set in constructor.
   uint spg;
@@ -113,6 +152,37 @@ struct randSpgInput {
   // the correct space group. Default is true.
   bool forceMostGeneralWyckPos;
 
+  // Seed for the random number generator. If it is non-zero, every attempt
+  // of randSpgCrystal() draws from its own counter-based stream keyed by
+  // (seed, spg, structureIndex, attempt index), so the same input always
+  // produces the same crystal. Default is 0 (the random number stream of the
+  // calling thread, seeded once from std::random_device, is used).
+  uint64_t seed;
+
+  // The index of this structure in a batch. It only matters if 'seed' is
+  // non-zero: it selects an independent random stream for every structure,
+  // so that structure i of a batch is identical no matter which thread or
+  // process generates it, or in which order. Default is 0.
+  uint structureIndex;
+
+  // When the atoms of a Wyckoff position cannot be placed, this many of the
+  // most recently placed orbits may be removed and placed again before the
+  // attempt is given up and a new lattice and new atom assignments are
+  // drawn. Orbits of unique positions are never placed again, since they
+  // have nowhere else to go. 0 turns this off. Default is 0.
+  uint backtrackDepth;
+
+  // The number of times each of the orbits above may be placed again before
+  // we back up further. Default is 3.
+  uint backtrackRetries;
+
+  // Place the orbits in order of how hard they are to place instead of in
+  // the order of the atom assignments: unique positions first, then the
+  // orbits that take up the most room (multiplicity times the cube of the
+  // radius of the atom). Big orbits then go into a cell that is still empty,
+  // and failures happen before much work has been done. Default is false.
+  bool placeByDifficulty;
+
   // Most basic constructor
   randSpgInput(uint _spg, const std::vector<uint>& _atoms,
                const latticeStruct& _lmins,
@@ -129,7 +199,12 @@ struct randSpgInput {
                    forcedWyckAssignments(std::vector<std::pair<uint, char>>()),
                    verbosity('n'),
                    maxAttempts(100),
-                   forceMostGeneralWyckPos(true) {}
+                   forceMostGeneralWyckPos(true),
+                   seed(0),
+                   structureIndex(0),
+                   backtrackDepth(0),
+                   backtrackRetries(3),
+                   placeByDifficulty(false) {}
   // Defining-everything constructor
   randSpgInput(uint _spg, const std::vector<uint>& _atoms,
                const latticeStruct& _lmins,
@@ -138,7 +213,10 @@ struct randSpgInput {
                const std::vector<std::pair<uint, double>>& _mar,
                double _minVolume, double _maxVolume,
                std::vector<std::pair<uint, char>> _fwa,
-               char _v, int _maxAttempts, bool _fmgwp) :
+               char _v, int _maxAttempts, bool _fmgwp,
+               uint64_t _seed = 0, uint _structureIndex = 0,
+               uint _backtrackDepth = 0, uint _backtrackRetries = 3,
+               bool _placeByDifficulty = false) :
                    spg(_spg),
                    atoms(_atoms),
                    latticeMins(_lmins),
@@ -151,9 +229,17 @@ struct randSpgInput {
                    forcedWyckAssignments(_fwa),
                    verbosity(_v),
                    maxAttempts(_maxAttempts),
-                   forceMostGeneralWyckPos(_fmgwp) {}
+                   forceMostGeneralWyckPos(_fmgwp),
+                   seed(_seed),
+                   structureIndex(_structureIndex),
+                   backtrackDepth(_backtrackDepth),
+                   backtrackRetries(_backtrackRetries),
+                   placeByDifficulty(_placeByDifficulty) {}
 };
 
+class GenerationPlan;
+class RandSpgContext;
+
 class RandSpg {
  public:
 
@@ -163,6 +249,27 @@ class RandSpg {
   static std::string getWyckCoords(const wyckPos& pos) {return std::get<2>(pos);};
   static bool containsUniquePosition(const wyckPos& pos) {return std::get<3>(pos);};
 
+  // The same info from a handle
+  static char getWyckLet(wyckHandle h) {return getWyckLet(getWyckPos(h));};
+  static uint getMultiplicity(wyckHandle h) {return getMultiplicity(getWyckPos(h));};
+  static std::string getWyckCoords(wyckHandle h) {return getWyckCoords(getWyckPos(h));};
+  static bool containsUniquePosition(wyckHandle h) {return containsUniquePosition(getWyckPos(h));};
+
+  static wyckHandle getWyckHandle(uint spg, uint index) {return (spg << 16) | index;};
+  static uint getWyckHandleSpg(wyckHandle h) {return h >> 16;};
+  static uint getWyckHandleIndex(wyckHandle h) {return h & 0xFFFF;};
+
+  /*
+   * Obtain the wyckoff position that a handle refers to
+   *
+   * @param h The handle of the wyckoff position
+   *
+   * @return Returns a constant reference to the wyckoff position in the
+   * database in wyckoffDatabase.h. Returns an empty position if the handle
+   * is invalid.
+   */
+  static const wyckPos& getWyckPos(wyckHandle h);
+
   /*
    * Obtain the wyckoff positions of a spacegroup from the database
    *
@@ -174,7 +281,18 @@ class RandSpg {
    */
   static const wyckoffPositions& getWyckoffPositions(uint spg);
 
-  static wyckPos getWyckPosFromWyckLet(uint spg, char wyckLet);
+  static const wyckPos& getWyckPosFromWyckLet(uint spg, char wyckLet);
+
+  /*
+   * Find the handle of a wyckoff position from its letter
+   *
+   * @param spg The spacegroup of the wyckoff position
+   * @param wyckLet The wyckoff letter
+   *
+   * @return Returns the handle of the wyckoff position. Returns the handle
+   * of an invalid position if it is not found.
+   */
+  static wyckHandle getWyckHandleFromWyckLet(uint spg, char wyckLet);
 
   static const fillCellInfo& getFillCellInfo(uint spg);
 
@@ -182,9 +300,64 @@ class RandSpg {
 
   static std::vector<std::string> getVectorOfFillPositions(uint spg);
 
+  /*
+   * Get the symmetry operations of a spacegroup compiled from the fill cell
+   * database. Every general position is combined with every centering
+   * translation, so applying all of them to an atom generates its orbit.
+   * The first operation is always the identity. The operations of every
+   * spacegroup are compiled the first time this is called.
+   *
+   * @param spg The spacegroup for which to get the symmetry operations.
+   *
+   * @return A constant reference to the vector of symmetry operations.
+   *         Returns an empty vector if an invalid spg is entered.
+   */
+  static const std::vector<affineTransform>& getSymmetryOperations(uint spg);
+
   static double interpretComponent(const std::string& component,
                                           double x, double y, double z);
 
+  /*
+   * Evaluate one component of a coordinate string, such as "-x+0.5", at a
+   * position.
+   *
+   * @param component The component to evaluate.
+   * @param x, y, z The position at which to evaluate it.
+   * @param result Set to the value of the component.
+   *
+   * @return True if the component was read. False if it is empty or its
+   *         syntax is invalid.
+   */
+  static bool interpretComponent(const std::string& component,
+                                 double x, double y, double z,
+                                 double& result);
+
+  /*
+   * Compile a coordinate string such as "-x+0.5,y,0.25" into an affine
+   * transformation. Every component must be linear in x, y, and z.
+   *
+   * @param coords The coordinate string to compile.
+   * @param result The affine transformation that will be set.
+   *
+   * @return True on success. False if a component could not be read.
+   */
+  static bool compileCoords(const std::string& coords,
+                            affineTransform& result);
+
+  /*
+   * Get the compiled coordinates of a Wyckoff position. The coordinates of
+   * every Wyckoff position in the database are compiled the first time this
+   * is called.
+   *
+   * @param spg The spacegroup of the Wyckoff position.
+   * @param wyckLet The letter of the Wyckoff position.
+   *
+   * @return A pointer to the compiled coordinates. Returns nullptr if the
+   *         Wyckoff position does not exist.
+   */
+  static const affineTransform* getCompiledWyckCoords(uint spg,
+                                                      char wyckLet);
+
   /*
    * Used to determine if a spacegroup is possible for a given set of atoms.
    * It is determined by using the multiplicities in the Wyckoff database.
@@ -198,6 +371,23 @@ class RandSpg {
    */
   static bool isSpgPossible(uint spg, const std::vector<uint>& atomTypes);
 
+  /*
+   * Determine which of the 230 spacegroups are possible for a given set of
+   * atoms. This gives the same results as calling isSpgPossible() for each
+   * of them, but the composition is only processed once, and the
+   * spacegroups that need to be searched are searched in parallel.
+   *
+   * @param atomTypes A vector of atomic numbers (one for each atom).
+   * @param numThreads The number of threads to use. If it is 0, the number
+   *                   of hardware threads is used.
+   *
+   * @return A bitset in which bit (spg - 1) is set if spacegroup spg may
+   *         be generated.
+   */
+  static std::bitset<230> getPossibleSpacegroups(
+                                       const std::vector<uint>& atomTypes,
+                                       uint numThreads = 0);
+
   /*
    * Generates a latticeStruct (contains a, b, c, alpha, beta, and gamma as
    * doubles) with randomly generated parameters for a given
@@ -216,6 +406,31 @@ class RandSpg {
   static latticeStruct generateLatticeForSpg(uint spg,
                                              const latticeStruct& mins,
                                              const latticeStruct& maxes);
+
+  /*
+   * The same as above, but the volume of the lattice is also within
+   * [minVolume, maxVolume], and the lengths are drawn directly from the
+   * range that satisfies both the volume and the mins and maxes. Nothing is
+   * drawn and rejected. The angles are drawn as above. The volume is then
+   * uniform in the range that those angles allow. The lengths are drawn one
+   * at a time in a random order, each uniformly in the range that still
+   * allows the volume, and the last one is solved for.
+   *
+   * @param spg The spacegroup for which to generate a lattice.
+   * @param mins The minimum values for the lattice parameters
+   * @param maxes The maximum values for the lattice parameters
+   * @param minVolume The minimum volume, or -1 for none.
+   * @param maxVolume The maximum volume, or -1 for none.
+   *
+   * @return The lattice, or a struct with all zero values if no lattice
+   *         satisfies the constraints. An error message will be printed to
+   *         stdout with information if it fails.
+   */
+  static latticeStruct generateLatticeForSpg(uint spg,
+                                             const latticeStruct& mins,
+                                             const latticeStruct& maxes,
+                                             double minVolume,
+                                             double maxVolume);
   /*
    * Attempts to add an atom randomly to a wyckoff position of a given crystal.
    * The position of the atom is constrained by the given wyckoff position.
@@ -270,6 +485,43 @@ class RandSpg {
    */
   static Crystal randSpgCrystal(const randSpgInput& input);
 
+  /*
+   * The same as above, but the radii, custom minIADs, random number stream,
+   * and log of the context are used instead of global state. Nothing global
+   * is modified, so threads with their own contexts may call this at the
+   * same time with different inputs. The radius settings of the input are
+   * ignored; those of the context are used.
+   *
+   * @param input The input.
+   * @param context The context. Unseeded generations advance its random
+   *                number stream.
+   *
+   * @return The crystal, or a Crystal with zero volume on failure.
+   */
+  static Crystal randSpgCrystal(const randSpgInput& input,
+                                RandSpgContext& context);
+
+  /*
+   * Prepare an input for generating many crystals. Everything that does not
+   * change between crystals (the system possibilities, the forced Wyckoff
+   * positions, and the minIAD table) is found once. Then call generate() on
+   * the plan for every crystal. randSpgCrystal() is the same as compiling
+   * and generating one crystal.
+   *
+   * @param input The input.
+   *
+   * @return The plan. If the spacegroup cannot be generated with this input,
+   *         the reason is printed and the plan is not valid.
+   */
+  static GenerationPlan compile(const randSpgInput& input);
+
+  /*
+   * The same as above, but the radii and custom minIADs of the context are
+   * used instead of those of the input.
+   */
+  static GenerationPlan compile(const randSpgInput& input,
+                                const RandSpgContext& context);
+
   static std::vector<numAndType> getNumOfEachType(
                                    const std::vector<uint>& atoms);
 
@@ -277,8 +529,27 @@ class RandSpg {
 
   static void printAtomAssignments(const atomAssignments& a);
 
+  // This is thread-safe
   static void appendToLogFile(const std::string& text);
 
+  // Append to a log file other than the default one. This is thread-safe,
+  // but it is never buffered.
+  static void appendToLogFile(const std::string& fileName,
+                              const std::string& text);
+
+  /*
+   * Buffer the text that the calling thread appends to the log file instead
+   * of writing it. This keeps the log of each structure together when
+   * several threads are generating structures at once.
+   */
+  static void startLogBuffer();
+
+  /*
+   * Write the text that was buffered since startLogBuffer() to the log file
+   * in one piece, and stop buffering.
+   */
+  static void flushLogBuffer();
+
 };
 
 #endif
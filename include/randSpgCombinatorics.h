@@ -49,8 +49,8 @@ combinations to put atoms in a given spacegroup.
 
 // This is a vector of similar Wyckoff positions
 // Wyckoff positions are considered similar if they share the same multiplicity
-// and uniqueness
-typedef std::vector<wyckPos> similarWyckPositions;
+// and uniqueness. They are stored as handles into the database.
+typedef std::vector<wyckHandle> similarWyckPositions;
 
 // This provides a set of choosable positions and how many we are supposed to
 // choose
@@ -110,13 +110,24 @@ typedef std::vector<systemPossibility> systemPossibilities;
 class RandSpgCombinatorics {
  public:
   // Returns all system possibilities that satisfy the constraints given
-  // by the spacegroup and input atoms
+  // by the spacegroup and input atoms. If findOnlyOne is set, this stops at
+  // the first one found, so it returns one possibility if there are any.
+  // Otherwise, this collects them with a SystemPossibilityIterator. Use one
+  // directly to walk through them without storing them all.
   static systemPossibilities getSystemPossibilities(
                                              uint spg,
                                              const std::vector<uint>& atoms,
                                              bool findOnlyOne = false,
                                              bool onlyNonUnique = false);
 
+  // Returns true if there is at least one system possibility. This is the
+  // search used by getSystemPossibilities() with findOnlyOne, but the
+  // composition is given as the output of RandSpg::getNumOfEachType().
+  static bool systemPossibilityExists(
+                            uint spg,
+                            const std::vector<numAndType>& numOfEachType,
+                            bool onlyNonUnique = false);
+
   // This removes all possibilities for which the wyckLet is NOT in the possible
   // setup. This does not guarantee, however, that the wyckoff position will be
   // used. You must force it to be selected with a special function that
@@ -133,6 +144,17 @@ class RandSpgCombinatorics {
                                           uint minNumUses,
                                           uint atomicNum);
 
+  // The tests used by removePossibilitiesWithoutWyckPos(). They may also be
+  // used as filters for a SystemPossibilityIterator.
+  static bool possibilityHasWyckPos(const systemPossibility& sysPos,
+                                    char wyckLet,
+                                    uint minNumUses = 1);
+
+  static bool possibilityHasWyckPos(const systemPossibility& sysPos,
+                                    char wyckLet,
+                                    uint minNumUses,
+                                    uint atomicNum);
+
   // This calls removePossibilitiesWithoutWyckPos() for the most general
   // Wyckoff position for the spacegroup
   static systemPossibilities removePossibilitiesWithoutGeneralWyckPos(
@@ -140,6 +162,12 @@ class RandSpgCombinatorics {
                                            uint spg,
                                            uint minNumUses = 1);
 
+  // Groups the Wyckoff positions of a spacegroup that have the same
+  // multiplicity and uniqueness, in the order used for the possibilities.
+  // The groups are only created once for each spacegroup.
+  static const std::vector<similarWyckPositions>& getSimilarWyckPositions(
+                                                                 uint spg);
+
   // Pick a random system possibility from the system possibilities
   static systemPossibility getRandomSystemPossibility(const systemPossibilities& sysPoss);
 
@@ -148,7 +176,13 @@ class RandSpgCombinatorics {
 
   static atomAssignments getRandomAtomAssignments(
              const systemPossibilities& sysPoss,
-             const std::vector<std::pair<uint, wyckPos>>& forcedWyckPositions);
+             const std::vector<std::pair<uint, wyckHandle>>& forcedWyckPositions);
+
+  // Get a random set of atom assignments from a system possibility that has
+  // already been chosen
+  static atomAssignments getRandomAtomAssignmentsFromPossibility(
+             systemPossibility sysPos,
+             const std::vector<std::pair<uint, wyckHandle>>& forcedWyckPositions);
 
   static std::string getSimilarWyckPosAndNumToChooseString(const similarWyckPosAndNumToChoose& simPos);
 
@@ -165,6 +199,9 @@ class RandSpgCombinatorics {
   static std::string getSystemPossibilitiesString(const systemPossibilities& pos);
 
   // To be added to the log file when the user specifies 'verbose' output
+  static std::string getVerbosePossibilityString(const systemPossibility& pos,
+                                                 size_t index);
+
   static std::string getVerbosePossibilitiesString(const systemPossibilities& pos);
 
   static void printSystemPossibilities(const systemPossibilities& pos);
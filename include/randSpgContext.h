@@ -0,0 +1,113 @@
+/**********************************************************************
+  randSpgContext.h - Class that holds the state of one generation: the
+                     radii, the custom minIADs, the random number stream,
+                     and where the log goes
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef RANDSPG_CONTEXT_H
+#define RANDSPG_CONTEXT_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "minIADTable.h"
+#include "randSpg.h"
+#include "rng.h"
+
+/* Everything that RandSpg::randSpgCrystal() used to keep in globals. The
+ * radii and custom minIADs of the input are applied to copies of the
+ * database radii here instead of to ElemInfo, and the log is written
+ * through a sink that belongs to the context. So generations with different
+ * inputs may run at the same time in one process, each with its own
+ * context.
+ *
+ * A context should only be used by one thread at a time, since its random
+ * number stream changes as it is used.
+ */
+class RandSpgContext {
+ public:
+  typedef std::function<void(const std::string&)> logSink;
+
+  /* Build the context from the radius settings of an input. The random
+   * number stream starts as a copy of the current stream of the calling
+   * thread, and the log goes to RandSpg::appendToLogFile().
+   *
+   * @param input The input whose IADScalingFactor, minRadius,
+   *              manualAtomicRadii, and customMinIADs are used.
+   */
+  explicit RandSpgContext(const randSpgInput& input);
+
+  /* Get the radius of an atomic number.
+   *
+   * @param atomicNum The atomic number.
+   * @param usingVdwRadii Whether to get the vdw radius instead of the
+   *                      covalent radius.
+   *
+   * @return The radius in Angstroms, or 0 for an invalid atomic number.
+   */
+  double getRadius(uint atomicNum, bool usingVdwRadii = false) const;
+
+  /* Get the custom minIAD of a pair of atomic numbers.
+   *
+   * @return The custom minIAD in Angstroms, or -1.0 if there is none.
+   */
+  double getCustomMinIAD(uint atomicNum1, uint atomicNum2) const;
+
+  /* Build the table of minIADs for a composition from the radii and custom
+   * minIADs of this context.
+   *
+   * @param atoms The atomic numbers of the composition. They may be repeated.
+   * @param usingVdwRadii Whether to use vdw radii instead of covalent radii.
+   *
+   * @return The table.
+   */
+  std::shared_ptr<const MinIADTable> createMinIADTable(
+                                      const std::vector<uint>& atoms,
+                                      bool usingVdwRadii = false) const;
+
+  /* Send the log to a function instead.
+   *
+   * @param sink The function that receives the text of the log.
+   */
+  void setLogSink(const logSink& sink) {m_logSink = sink;};
+
+  /* Send the log to a file instead.
+   *
+   * @param fileName The file to append the log to.
+   */
+  void setLogFile(const std::string& fileName);
+
+  /* Append text to the log.
+   *
+   * @param text The text to append.
+   */
+  void appendToLog(const std::string& text) const;
+
+  /* @return The random number stream that unseeded generations draw from.
+   */
+  RandStream& getRandStream() {return m_randStream;};
+
+ private:
+  // Indexed by atomic number
+  std::vector<double> m_covalentRadii;
+  std::vector<double> m_vdwRadii;
+  std::vector<std::pair<std::pair<uint, uint>, double>> m_customMinIADs;
+  logSink m_logSink;
+  RandStream m_randStream;
+};
+
+#endif
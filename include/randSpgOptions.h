@@ -16,6 +16,7 @@
 #ifndef RAND_SPG_OPTIONS_H
 #define RAND_SPG_OPTIONS_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -88,6 +89,11 @@ class RandSpgOptions {
   int getMaxAttempts() const {return m_maxAttempts;};
   std::string getOutputDir() const {return m_outputDir;};
   char getVerbosity() const {return m_verbosity;};
+  uint64_t getSeed() const {return m_seed;};
+  uint getNumThreads() const {return m_numThreads;};
+  uint getBacktrackDepth() const {return m_backtrackDepth;};
+  uint getBacktrackRetries() const {return m_backtrackRetries;};
+  bool placeByDifficulty() const {return m_placeByDifficulty;};
   // This will return false if the options are invalid
   bool optionsAreValid() const {return m_optionsAreValid;};
 
@@ -109,6 +115,11 @@ class RandSpgOptions {
   void setMaxAttempts(int i) {m_maxAttempts = i;};
   void setOutputDir(const std::string& s) {m_outputDir = s;};
   void setVerbosity(char c) {m_verbosity = c;};
+  void setSeed(uint64_t u) {m_seed = u;};
+  void setNumThreads(uint u) {m_numThreads = u;};
+  void setBacktrackDepth(uint u) {m_backtrackDepth = u;};
+  void setBacktrackRetries(uint u) {m_backtrackRetries = u;};
+  void setPlaceByDifficulty(bool b) {m_placeByDifficulty = b;};
 
  private:
   // m_filename: string for the filename that the options were read from
@@ -169,6 +180,27 @@ class RandSpgOptions {
   // and 'v' for verbose.
   char m_verbosity;
 
+  // m_seed: the seed for the random number generator. 0 means that the
+  // output is not reproducible.
+  uint64_t m_seed;
+
+  // m_numThreads: the number of threads that generate structures. 0 means
+  // that one is used for each hardware thread.
+  uint m_numThreads;
+
+  // m_backtrackDepth: the number of placed orbits that may be placed again
+  // when an orbit cannot be placed. 0 means that the whole attempt is given
+  // up instead.
+  uint m_backtrackDepth;
+
+  // m_backtrackRetries: the number of times each of those orbits may be
+  // placed again
+  uint m_backtrackRetries;
+
+  // m_placeByDifficulty: whether to place the hardest orbits first instead
+  // of in the order of the atom assignments
+  bool m_placeByDifficulty;
+
   // This will be false if the options are not valid
   bool m_optionsAreValid;
 };
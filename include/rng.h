@@ -1,8 +1,10 @@
 /**********************************************************************
-  rng.h - Provides a function to generate random doubles between a min
-          and a max value
+  rng.h - Provides counter-based random number streams, a per-thread
+          current stream, and functions to generate random doubles and ints
+          between a min and a max value
 
   Copyright (C) 2016 by Patrick S. Avery
+  Copyright (C) 2026 by the RandSpg contributors
 
   This source code is released under the New BSD License, (the "License").
 
@@ -17,39 +19,184 @@
 #ifndef RNG_H
 #define RNG_H
 
+#include <chrono>
+#include <cstdint>
 #include <random>
 
-// C++11 way of generating random numbers in a thread-safe manner...
-// Creating a new distribution each time is supposedly very fast...
-static inline double getRandDouble(double min, double max)
+// Obtain a seed for a new random number stream
+static inline uint64_t getNewRandSeed()
 {
-  // Unfortunately, MinGW does not make use of these modern random number
-  // generators, so we have to resort to an old fashioned method (which may
-  // not be as good...)
+  // Unfortunately, MinGW's std::random_device is deterministic, so we have
+  // to resort to using the clock there...
 #ifdef __MINGW32__
-  return (static_cast<double>(rand()) / static_cast<double>(RAND_MAX)) *
-         (max - min) + min;
+  return static_cast<uint64_t>(
+    std::chrono::high_resolution_clock::now().time_since_epoch().count());
 #else
-  // These random number generators are probably better.
-  std::mt19937 generator(std::random_device{}());
-  std::uniform_real_distribution<double> distribution(min, max);
-  return distribution(generator);
+  std::random_device rd;
+  return (static_cast<uint64_t>(rd()) << 32) | rd();
 #endif
 }
 
-static inline int getRandInt(int min, int max)
+/* A counter-based random number stream (Philox4x32-10).
+ *
+ * The nth number of a stream is a pure function of the seed, the stream
+ * coordinates (spacegroup, structure index, attempt index) and n. So a stream
+ * does not depend on what any other stream has drawn, and a structure
+ * generated with a given seed is bit-identical no matter which thread or
+ * process generates it, or in which order. The conversions to doubles and
+ * ints are done here rather than with the std distributions so that they
+ * are identical on every platform as well.
+ *
+ * It also satisfies the requirements of a uniform random bit generator, so it
+ * may be used with the std distributions and algorithms.
+ */
+class RandStream {
+ public:
+  typedef uint32_t result_type;
+
+  explicit RandStream(uint64_t seed = 0, uint32_t spg = 0,
+                      uint32_t structureIndex = 0, uint32_t attempt = 0) :
+    m_bufferPos(4)
+  {
+    m_key[0] = static_cast<uint32_t>(seed);
+    m_key[1] = static_cast<uint32_t>(seed >> 32);
+    // The first counter word counts blocks within the stream. The others
+    // identify the stream.
+    m_counter[0] = 0;
+    m_counter[1] = attempt;
+    m_counter[2] = structureIndex;
+    m_counter[3] = spg;
+  }
+
+  static constexpr result_type min() {return 0;};
+  static constexpr result_type max() {return 0xFFFFFFFF;};
+
+  result_type operator()()
+  {
+    if (m_bufferPos == 4) {
+      generateBlock();
+      m_bufferPos = 0;
+    }
+    return m_buffer[m_bufferPos++];
+  }
+
+  uint64_t nextUInt64()
+  {
+    uint64_t hi = (*this)();
+    return (hi << 32) | (*this)();
+  }
+
+  // A double in [0, 1) with 53 random bits
+  double nextDouble()
+  {
+    return (nextUInt64() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  double getDouble(double min, double max)
+  {
+    return min + (max - min) * nextDouble();
+  }
+
+  // An unbiased int in [min, max] (Lemire's multiply and reject)
+  int getInt(int min, int max)
+  {
+    uint32_t range = static_cast<uint32_t>(max) - static_cast<uint32_t>(min)
+                     + 1;
+    if (range == 0) return static_cast<int>((*this)());
+    uint64_t m = static_cast<uint64_t>((*this)()) * range;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < range) {
+      uint32_t threshold = (0u - range) % range;
+      while (low < threshold) {
+        m = static_cast<uint64_t>((*this)()) * range;
+        low = static_cast<uint32_t>(m);
+      }
+    }
+    return static_cast<int>(static_cast<uint32_t>(min) +
+                            static_cast<uint32_t>(m >> 32));
+  }
+
+ private:
+  static inline void mulhilo(uint32_t a, uint32_t b,
+                             uint32_t& hi, uint32_t& lo)
+  {
+    uint64_t product = static_cast<uint64_t>(a) * b;
+    hi = static_cast<uint32_t>(product >> 32);
+    lo = static_cast<uint32_t>(product);
+  }
+
+  void generateBlock()
+  {
+    uint32_t ctr[4] = {m_counter[0], m_counter[1], m_counter[2], m_counter[3]};
+    uint32_t key[2] = {m_key[0], m_key[1]};
+    for (int round = 0; round < 10; ++round) {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53, ctr[0], hi0, lo0);
+      mulhilo(0xCD9E8D57, ctr[2], hi1, lo1);
+      uint32_t next[4] = {hi1 ^ ctr[1] ^ key[0], lo1,
+                          hi0 ^ ctr[3] ^ key[1], lo0};
+      ctr[0] = next[0]; ctr[1] = next[1]; ctr[2] = next[2]; ctr[3] = next[3];
+      key[0] += 0x9E3779B9;
+      key[1] += 0xBB67AE85;
+    }
+    for (int i = 0; i < 4; ++i) m_buffer[i] = ctr[i];
+    ++m_counter[0];
+  }
+
+  uint32_t m_key[2];
+  uint32_t m_counter[4];
+  uint32_t m_buffer[4];
+  int m_bufferPos;
+};
+
+// Every thread has one current stream that getRandDouble() and getRandInt()
+// draw from. Until a stream is explicitly set, it is a stream seeded from
+// std::random_device (seeded once per thread). These functions are
+// deliberately not 'static' so that every translation unit shares the same
+// stream.
+inline RandStream& getRandEngine()
 {
-  // Unfortunately, MinGW does not make use of these modern random number
-  // generators, so we have to resort to an old fashioned method (which may
-  // not be as good...)
-#ifdef __MINGW32__
-  return rand() % (max + 1 - min) + min;
-#else
-  // These random number generators are probably better.
-  std::mt19937 generator(std::random_device{}());
-  std::uniform_int_distribution<int> distribution(min, max);
-  return distribution(generator);
-#endif
+  thread_local RandStream stream(getNewRandSeed());
+  return stream;
+}
+
+// Replace the current stream of the calling thread.
+inline void setRandStream(const RandStream& stream)
+{
+  getRandEngine() = stream;
+}
+
+// Re-seed the current stream of the calling thread. Useful for reproducible
+// output.
+inline void seedRandEngine(uint64_t seed)
+{
+  setRandStream(RandStream(seed));
+}
+
+// Sets the current stream of the calling thread for the lifetime of this
+// object and restores the previous stream when it goes out of scope.
+class ScopedRandStream {
+ public:
+  explicit ScopedRandStream(const RandStream& stream) :
+    m_previous(getRandEngine())
+  {
+    setRandStream(stream);
+  }
+
+  ~ScopedRandStream() {setRandStream(m_previous);};
+
+ private:
+  RandStream m_previous;
+};
+
+inline double getRandDouble(double min, double max)
+{
+  return getRandEngine().getDouble(min, max);
+}
+
+inline int getRandInt(int min, int max)
+{
+  return getRandEngine().getInt(min, max);
 }
 
 #endif
@@ -0,0 +1,89 @@
+/**********************************************************************
+  systemPossibilityCache.h - Static class for sharing the system
+                             possibilities of a spacegroup and composition
+                             between calls
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef SYSTEM_POSSIBILITY_CACHE_H
+#define SYSTEM_POSSIBILITY_CACHE_H
+
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "systemPossibilitySampler.h"
+
+/* Keeps the most recently used SystemPossibilitySamplers, so that
+ * generating many crystals of the same spacegroup and composition only
+ * counts their system possibilities once.
+ *
+ * The possibilities only depend on the number of atoms of each atom type,
+ * not on which elements they are. So the samplers are created with the
+ * index of each atom type (in the order of RandSpg::getNumOfEachType()) in
+ * place of its atomic number, and Ti4O8 and Si4O8 share a sampler. Use
+ * relabel() to put the atomic numbers back into a possibility.
+ *
+ * All of the functions are thread-safe.
+ */
+class SystemPossibilityCache {
+ public:
+  /* Get the sampler for a spacegroup and composition, with the requirements
+   * applied. It is created if it is not in the cache yet.
+   *
+   * @param spg The spacegroup.
+   * @param numOfEachType The number of atoms of each atom type and their
+   *                      atomic numbers, as returned by
+   *                      RandSpg::getNumOfEachType().
+   * @param forcedWyckAssignments The forced Wyckoff positions as tuples of
+   *                              <atomicNum, wyckLet, minNumUses>.
+   * @param forceMostGeneralWyckPos Whether the most general Wyckoff position
+   *                                must be used.
+   *
+   * @return The sampler. Its possibilities use the index of each atom type
+   *         as its atomic number.
+   */
+  static std::shared_ptr<const SystemPossibilitySampler> getSampler(
+    uint spg,
+    const std::vector<numAndType>& numOfEachType,
+    const std::vector<std::tuple<uint, char, uint>>& forcedWyckAssignments,
+    bool forceMostGeneralWyckPos);
+
+  /* Replace the atom type indices of a possibility from one of the cached
+   * samplers with their atomic numbers.
+   *
+   * @param pos The system possibility to relabel.
+   * @param numOfEachType The same vector that was used to get the sampler.
+   */
+  static void relabel(systemPossibility& pos,
+                      const std::vector<numAndType>& numOfEachType);
+
+  /* Set the maximum number of samplers to keep. The least recently used
+   * ones are removed first.
+   *
+   * @param maxSize The maximum number of samplers to keep.
+   */
+  static void setMaxSize(size_t maxSize);
+
+  static size_t getMaxSize();
+
+  /* @return The number of samplers in the cache.
+   */
+  static size_t size();
+
+  /* Remove all of the samplers from the cache.
+   */
+  static void clear();
+};
+
+#endif
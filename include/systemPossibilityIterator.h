@@ -0,0 +1,120 @@
+/**********************************************************************
+  systemPossibilityIterator.h - Class for walking through the system
+                                possibilities of a spacegroup and
+                                composition one at a time
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef SYSTEM_POSSIBILITY_ITERATOR_H
+#define SYSTEM_POSSIBILITY_ITERATOR_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "systemPossibilitySampler.h"
+
+/* Walks through the system possibilities of a SystemPossibilitySampler in
+ * order, creating only one of them at a time. So it may be used when there
+ * are far too many possibilities to store them all.
+ *
+ * The current possibility is a usage of each atom type, like an odometer
+ * in which the last atom type changes the fastest. That is the same order
+ * that joinSingleWithSystem() puts them in. Usages that cannot be finished
+ * are never entered, so moving to the next possibility only changes the
+ * atom types after the last one that could move on. Seeking to an index
+ * uses the counts of the sampler, so it does not have to walk there.
+ *
+ * Filters may also be added. Possibilities that do not pass all of them
+ * are skipped. The sampler must outlive the iterator, and its requirements
+ * must not be changed while the iterator is used.
+ */
+class SystemPossibilityIterator {
+ public:
+  typedef std::function<bool(const systemPossibility&)> filter;
+
+  /* @param sampler The sampler whose possibilities to walk through.
+   * @param index The index to start at.
+   */
+  explicit SystemPossibilityIterator(const SystemPossibilitySampler& sampler,
+                                     double index = 0);
+
+  /* Only include possibilities for which the filter returns true. If the
+   * current possibility does not pass it, the iterator moves on to the next
+   * one that does.
+   *
+   * @param f The filter.
+   */
+  void addFilter(const filter& f);
+
+  /* @return True if there are no more possibilities.
+   */
+  bool atEnd() const {return m_index >= m_numPossibilities;};
+
+  /* Get the current possibility. The iterator must not be at the end.
+   *
+   * @return The current system possibility.
+   */
+  const systemPossibility& get() const {return m_current;};
+  const systemPossibility& operator*() const {return m_current;};
+  const systemPossibility* operator->() const {return &m_current;};
+
+  /* Move on to the next possibility.
+   */
+  void next();
+  SystemPossibilityIterator& operator++() {next(); return *this;};
+
+  /* Move to the possibility at an index of the sampler. If it does not
+   * pass the filters, this moves on to the next one that does.
+   *
+   * @param index The index to move to.
+   */
+  void seek(double index);
+
+  /* Skip over a number of possibilities. Only possibilities that pass the
+   * filters are counted. Without filters, this does not walk through them.
+   *
+   * @param num The number of possibilities to skip.
+   */
+  void skip(double num);
+
+  /* @return The index of the current possibility in the sampler. It is the
+   *         number of possibilities if the iterator is at the end.
+   */
+  double getIndex() const {return m_index;};
+
+ private:
+  // Choose the first usage of an atom type, starting at usageIndex, that
+  // can be finished. Returns false if there are none.
+  bool chooseUsage(size_t typeIndex, size_t usageIndex);
+
+  // Moves to the next possibility without checking the filters
+  void advance();
+
+  bool passesFilters() const;
+
+  // Moves forward until the current possibility passes the filters
+  void skipFiltered();
+
+  const SystemPossibilitySampler& m_sampler;
+  double m_numPossibilities;
+  double m_index;
+  // The chosen usage of each atom type
+  std::vector<size_t> m_choices;
+  // The state before each atom type, and after the last one
+  std::vector<uint64_t> m_states;
+  systemPossibility m_current;
+  std::vector<filter> m_filters;
+};
+
+#endif
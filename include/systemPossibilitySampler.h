@@ -0,0 +1,220 @@
+/**********************************************************************
+  systemPossibilitySampler.h - Class for counting the system possibilities
+                               of a spacegroup and composition, and for
+                               picking one of them, without having to
+                               create all of them
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#ifndef SYSTEM_POSSIBILITY_SAMPLER_H
+#define SYSTEM_POSSIBILITY_SAMPLER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "randSpg.h"
+#include "randSpgCombinatorics.h"
+
+/* RandSpgCombinatorics::getSystemPossibilities() creates every combination
+ * of the possibilities of each atom type, which grows very quickly with the
+ * number of atom types. This class only creates the possibilities of each
+ * atom type individually. It then counts how many system possibilities
+ * there are with dynamic programming, and can create the system possibility
+ * at any index directly.
+ *
+ * The atom types are considered one at a time. The only things that an atom
+ * type's choices pass on to the following atom types are how many of each
+ * unique Wyckoff position have been used, and whether the most general
+ * Wyckoff position has been used. So the number of ways to finish a system
+ * possibility only depends on those, and it is computed once for each of
+ * them.
+ *
+ * The possibilities are indexed in the same order as the vector returned by
+ * getSystemPossibilities() after the same possibilities have been removed
+ * from it. So getPossibility(i) is the ith element of that vector.
+ *
+ * The counts are found the first time they are needed, and every count
+ * that may be needed later is found along with them. So once
+ * getNumPossibilities() has been called, the const functions do not change
+ * the sampler, and it may be shared between threads.
+ */
+class SystemPossibilitySampler {
+ public:
+  /* @param spg The spacegroup.
+   * @param atoms The atomic numbers of the composition. They may be repeated.
+   */
+  SystemPossibilitySampler(uint spg, const std::vector<uint>& atoms);
+
+  /* @param spg The spacegroup.
+   * @param numOfEachType The number of atoms of each atom type and their
+   *                      atomic numbers, as returned by
+   *                      RandSpg::getNumOfEachType(). The possibilities use
+   *                      the atom types in this order.
+   */
+  SystemPossibilitySampler(uint spg,
+                           const std::vector<numAndType>& numOfEachType);
+
+  /* Only include possibilities that use the most general Wyckoff position at
+   * least once. Same as
+   * RandSpgCombinatorics::removePossibilitiesWithoutGeneralWyckPos().
+   */
+  void requireGeneralWyckPos();
+
+  /* Only include possibilities in which an atom type may use a Wyckoff
+   * position at least a certain number of times. Same as
+   * RandSpgCombinatorics::removePossibilitiesWithoutWyckPos() with an
+   * atomic number.
+   * The uses are reserved before the other usages of the atom type are
+   * enumerated, so the usages that do not have them are never created.
+   *
+   * @param atomicNum The atomic number of the atom type.
+   * @param wyckLet The Wyckoff letter.
+   * @param minNumUses The minimum number of times it may be used.
+   */
+  void requireWyckPos(uint atomicNum, char wyckLet, uint minNumUses);
+
+  /* Only include possibilities that do not use any unique Wyckoff
+   * positions. Same as the 'onlyNonUnique' option of
+   * RandSpgCombinatorics::getSystemPossibilities().
+   */
+  void excludeUniqueWyckPos();
+
+  /* Get the number of system possibilities. It is exact as long as it is
+   * less than 2^53.
+   *
+   * @return The number of system possibilities.
+   */
+  double getNumPossibilities() const;
+
+  /* Create the system possibility at an index.
+   *
+   * @param index The index. It should be less than getNumPossibilities().
+   *
+   * @return The system possibility. It is empty if there are none.
+   */
+  systemPossibility getPossibility(double index) const;
+
+  /* Pick a random system possibility. Every possibility is equally likely.
+   * This draws the same random number as
+   * RandSpgCombinatorics::getRandomSystemPossibility(), so they pick the
+   * same possibility.
+   *
+   * @return The system possibility. It is empty if there are none.
+   */
+  systemPossibility getRandomPossibility() const;
+
+ private:
+  friend class AtomAssignmentSampler;
+  friend class SystemPossibilityIterator;
+
+  // Similar Wyckoff positions (same multiplicity and uniqueness)
+  struct wyckGroup {
+    uint multiplicity;
+    bool unique;
+    similarWyckPositions positions;
+    // For unique groups: the first bit of this group's field in the state
+    uint shift;
+  };
+
+  // What an atom type's usage does to the state. It is added to the
+  // state. The first bit is set if the usage uses the most general
+  // position.
+  typedef uint64_t usageMask;
+
+  // The number of times one atom type uses each group
+  typedef std::vector<uint> groupUsage;
+
+  // Enumerates the usages of an atom type. Each group is used as many times
+  // as it can be before the next one, which is the order that
+  // getSystemPossibilities() has always returned them in. Only the usages
+  // that meet the minimum usages are enumerated: 'numAtomsReserved' is the
+  // number of atoms that the groups from 'firstAvailable' on still need to
+  // meet them, and branches that cannot do so are never entered.
+  void findAllUsages(std::vector<groupUsage>& usages, groupUsage& usage,
+                     const groupUsage& minUsage, size_t firstAvailable,
+                     uint numAtomsLeft, uint numAtomsReserved) const;
+
+  // Enumerate the usages of an atom type with its requirements
+  void createUsages(size_t typeIndex);
+
+  // Create the masks of every usage, and find which atom types may still
+  // use the most general position
+  void createMasks();
+
+  // Checks if an atom type may use a usage when the previous atom types
+  // have used 'state'. If it can, sets 'nextState'.
+  bool canUse(size_t typeIndex, size_t usageIndex, uint64_t state,
+              uint64_t& nextState) const
+  {
+    usageMask mask = m_masks[typeIndex][usageIndex];
+    nextState = (state + (mask & ~uint64_t(1))) | (mask & 1);
+    return (nextState & m_guardMask) == 0;
+  }
+
+  // The number of ways to finish a system possibility starting at atom
+  // type 'typeIndex'
+  double countCompletions(size_t typeIndex, uint64_t state) const;
+
+  // Finds the usage of each atom type for the possibility at an index, and
+  // the state before each atom type. If the index is too large, this finds
+  // the last possibility. Returns false if there are no possibilities.
+  bool findChoices(double index, std::vector<size_t>& choices,
+                   std::vector<uint64_t>& states) const;
+
+  // Draw a random index that is less than 'num', the number of
+  // possibilities
+  double getRandomIndex(double num) const;
+
+  // Create the single atom possibility of an atom type for one of its
+  // usages
+  singleAtomPossibility createSingleAtomPossibility(size_t typeIndex,
+                                                    size_t usageIndex) const;
+
+  // Get the index of the group with a Wyckoff letter, or -1
+  int getGroupIndex(char wyckLet) const;
+
+  void clearCounts() const;
+
+  std::vector<wyckGroup> m_groups;
+  // <number, atomicNum> in the same order as RandSpg::getNumOfEachType()
+  std::vector<numAndType> m_types;
+  // Only the usages that meet the requirements
+  std::vector<std::vector<groupUsage>> m_usages;
+  // The minimum usage of each group for each atom type
+  std::vector<groupUsage> m_minUsages;
+  int m_generalGroup;
+  bool m_requireGeneral;
+  bool m_excludeUnique;
+  // True if a requirement can never be satisfied
+  bool m_impossible;
+
+  // The masks of m_usages
+  std::vector<std::vector<usageMask>> m_masks;
+  // Whether any atom type from each index on may use the most general
+  // position. If the general position is required and has not been used
+  // yet, there is no point in looking further when this is false.
+  std::vector<bool> m_generalUsableFrom;
+
+  // The states are bit fields. The first bit is whether the general
+  // position has been used. Then each unique group has a field with the
+  // number of times it has been used. The fields start out with a bias so
+  // that using a group more times than it has positions sets the top bit of
+  // its field. So joining a usage to a state only takes an addition, and
+  // checking that it is allowed only takes a mask.
+  uint64_t m_initialState;
+  uint64_t m_guardMask;
+  mutable std::vector<std::unordered_map<uint64_t, double>> m_counts;
+};
+
+#endif
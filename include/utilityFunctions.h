@@ -150,6 +150,17 @@ static inline bool numIsOdd(int num)
   return !numIsEven(num);
 }
 
+// The greatest common divisor. getGcd(0, b) is b.
+static inline uint getGcd(uint a, uint b)
+{
+  while (b != 0) {
+    uint temp = a % b;
+    a = b;
+    b = temp;
+  }
+  return a;
+}
+
 static inline bool isDigit(char d)
 {
   if (d != '0' && d != '1' && d != '2' && d != '3' && d != '4' &&
@@ -1,3 +1,4 @@
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <string>
@@ -5,8 +6,11 @@
 #include <tuple>
 
 #include "crystal.h"
+#include "generationPlan.h"
 #include "randSpg.h"
 #include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
+#include "systemPossibilityCache.h"
 #include "wyckoffDatabase.h"
 
 namespace py = pybind11;
@@ -172,24 +176,139 @@ PYBIND11_MODULE(pyrandspg, m) {
                      "to true, then more compositions are possible for some "
                      "space groups, but the final space group will not be "
                      "guaranteed to be the correct space group. "
-                     "Default is true.");
+                     "Default is true.")
+      .def_readwrite("seed", &randSpgInput::seed,
+                     "Seed for the random number generator. If it is "
+                     "non-zero, the same input always produces the same "
+                     "crystal. Default is 0 (seeded from the system's "
+                     "entropy source).")
+      .def_readwrite("structureIndex", &randSpgInput::structureIndex,
+                     "The index of this structure in a batch. If 'seed' is "
+                     "non-zero, it selects an independent random stream for "
+                     "every structure, so that a structure is reproducible "
+                     "no matter how the batch is distributed. Default is 0.")
+      .def_readwrite("backtrackDepth", &randSpgInput::backtrackDepth,
+                     "The number of the most recently placed Wyckoff orbits "
+                     "that may be placed again when an orbit cannot be "
+                     "placed, before a new lattice is drawn. Default is 0 "
+                     "(off).")
+      .def_readwrite("backtrackRetries", &randSpgInput::backtrackRetries,
+                     "The number of times each of those orbits may be "
+                     "placed again. Default is 3.")
+      .def_readwrite("placeByDifficulty", &randSpgInput::placeByDifficulty,
+                     "Place unique positions first, then the orbits that "
+                     "take up the most room, instead of placing them in the "
+                     "order of the atom assignments. Default is false.");
+
+  py::class_<RandSpgContext>(m, "RandSpgContext", "The radii, custom "
+                             "minIADs, random number stream, and log of "
+                             "a generation")
+      .def(py::init<const randSpgInput&>(), "Build the context from the "
+           "radius settings of an input")
+      .def("getRadius", &RandSpgContext::getRadius, "Get the radius of an "
+           "atomic number", py::arg("atomicNum"),
+           py::arg("usingVdwRadii") = false)
+      .def("getCustomMinIAD", &RandSpgContext::getCustomMinIAD, "Get the "
+           "custom minIAD of a pair of atomic numbers, or -1.0 if there is "
+           "none")
+      .def("setLogFile", &RandSpgContext::setLogFile, "Append the log to "
+           "this file")
+      .def("setLogSink", &RandSpgContext::setLogSink, "Send the text of the "
+           "log to this function");
+
+  py::class_<GenerationPlan>(m, "GenerationPlan", "An input that has been "
+                             "prepared for generating many crystals")
+      .def("isValid", &GenerationPlan::isValid, "False if the spacegroup "
+           "cannot be generated with this input")
+      .def("getInput", &GenerationPlan::getInput, "Get the input of the plan")
+      .def("getNumPossibilities", &GenerationPlan::getNumPossibilities,
+           "Get the number of system possibilities")
+      .def("generate",
+           (Crystal (GenerationPlan::*)(RandSpgContext&, uint) const)
+             &GenerationPlan::generate,
+           "Generate a crystal with a context and a structure index")
+      .def("generate",
+           (Crystal (GenerationPlan::*)(RandSpgContext&) const)
+             &GenerationPlan::generate,
+           "Generate a crystal with a context")
+      .def("generate",
+           (std::vector<Crystal> (GenerationPlan::*)(size_t,
+                                                     RandSpgContext&) const)
+             &GenerationPlan::generate,
+           "Generate several crystals with a context")
+      .def("generate",
+           (std::vector<Crystal> (GenerationPlan::*)(size_t) const)
+             &GenerationPlan::generate,
+           "Generate several crystals");
 
   py::class_<RandSpg>(m, "RandSpg", "Static method class for performing "
                       "primary RandSpg procedures.")
-      .def("randSpgCrystal", &RandSpg::randSpgCrystal, "Generate a random "
-           "crystal with a specific space group and all other constraints "
-           "given in the input struct")
-      .def("generateLatticeForSpg", &RandSpg::generateLatticeForSpg,
+      .def("randSpgCrystal",
+           (Crystal (*)(const randSpgInput&)) &RandSpg::randSpgCrystal,
+           "Generate a random crystal with a specific space group and all "
+           "other constraints given in the input struct")
+      .def("randSpgCrystal",
+           (Crystal (*)(const randSpgInput&, RandSpgContext&))
+             &RandSpg::randSpgCrystal,
+           "Generate a random crystal using the radii, random number "
+           "stream, and log of a context instead of global state")
+      .def_static("compile",
+                  (GenerationPlan (*)(const randSpgInput&)) &RandSpg::compile,
+                  "Prepare an input for generating many crystals")
+      .def_static("compile",
+                  (GenerationPlan (*)(const randSpgInput&,
+                                      const RandSpgContext&))
+                    &RandSpg::compile,
+                  "Prepare an input for generating many crystals, using the "
+                  "radii and custom minIADs of a context")
+      .def("generateLatticeForSpg",
+           (latticeStruct (*)(uint, const latticeStruct&,
+                              const latticeStruct&))
+             &RandSpg::generateLatticeForSpg,
            "Generates a latticeStruct with randomly generated parameters "
            "for a given spacegroup, mins, and maxes")
+      .def("generateLatticeForSpg",
+           (latticeStruct (*)(uint, const latticeStruct&,
+                              const latticeStruct&, double, double))
+             &RandSpg::generateLatticeForSpg,
+           "Generates a latticeStruct with randomly generated parameters "
+           "for a given spacegroup, mins, maxes, minVolume, and maxVolume")
       .def("getNumOfEachType", &RandSpg::getNumOfEachType, "Gets number of "
            "each atomic number")
       .def("getWyckoffPositions", &RandSpg::getWyckoffPositions, "Gets "
            "wyckoff positions for given space group")
       .def("isSpgPossible", &RandSpg::isSpgPossible, "Used to determine if "
            "a spacegroup is possible for a given set of atoms.")
-      .def("getAtomAssignmentsString", &RandSpg::getAtomAssignmentsString,
-           "Returns string of given AtomAssignment");
+      .def_static("getPossibleSpacegroups",
+                  [](const std::vector<uint>& atoms, uint numThreads)
+                  {
+                    std::bitset<230> possible =
+                      RandSpg::getPossibleSpacegroups(atoms, numThreads);
+                    std::vector<uint> spgs;
+                    for (uint spg = 1; spg <= 230; spg++) {
+                      if (possible[spg - 1]) spgs.push_back(spg);
+                    }
+                    return spgs;
+                  },
+                  "Returns a list of every spacegroup that is possible for "
+                  "a given set of atoms", py::arg("atoms"),
+                  py::arg("numThreads") = 0)
+      .def("getWyckPos", &RandSpg::getWyckPos, "Gets the wyckoff position "
+           "that a handle refers to")
+      .def("getWyckHandleFromWyckLet", &RandSpg::getWyckHandleFromWyckLet,
+           "Gets the handle of a wyckoff position from its letter")
+      .def("getAtomAssignmentsString",
+           [](const std::vector<std::pair<wyckPos, uint>>& a)
+           {
+             std::string s = "printing atom assignments:\n";
+             s += "Atomic num : Wyckoff letter\n";
+             for (size_t i = 0; i < a.size(); i++) {
+               s += std::to_string(a[i].second) + " : ";
+               s += RandSpg::getWyckLet(a[i].first);
+               s += "\n";
+             }
+             return s;
+           }, "Returns string of given AtomAssignment");
 
   py::class_<similarWyckPosAndNumToChoose>(m, "similarWyckPosAndNumToChoose",
                                            "Static class provides a set of "
@@ -198,9 +317,15 @@ PYBIND11_MODULE(pyrandspg, m) {
       .def_readwrite("numToChoose", &similarWyckPosAndNumToChoose::numToChoose,
                      "Number of similar multiplicities and uniqueness wyckoff "
                      "position to choose")
-      .def_readwrite("choosablePositions",
-                     &similarWyckPosAndNumToChoose::choosablePositions,
-                     "Chooseable wyckoff positions");
+      .def_property_readonly("choosablePositions",
+                             [](const similarWyckPosAndNumToChoose& s)
+                             {
+                               std::vector<wyckPos> positions;
+                               for (wyckHandle h : s.choosablePositions)
+                                 positions.push_back(RandSpg::getWyckPos(h));
+                               return positions;
+                             },
+                             "Chooseable wyckoff positions");
       // .def("__repr__", &similarWyckPosAndNumToChoose::toString, "Explicitly "
       // "printed out on screen");
 
@@ -227,6 +352,32 @@ PYBIND11_MODULE(pyrandspg, m) {
            &RandSpgCombinatorics::getRandomSystemPossibility, "Pick a random "
            "system possibility from the system possibilities")
       .def("getRandomAtomAssignments",
-           &RandSpgCombinatorics::getRandomAtomAssignments, "Get a random set "
-           "of atom assignments from all the system possibilities");
+           [](const systemPossibilities& sysPoss,
+              const std::vector<std::pair<uint, wyckHandle>>& forced)
+           {
+             atomAssignments a =
+               RandSpgCombinatorics::getRandomAtomAssignments(sysPoss, forced);
+             std::vector<std::pair<wyckPos, uint>> ret;
+             for (size_t i = 0; i < a.size(); i++)
+               ret.push_back(std::make_pair(RandSpg::getWyckPos(a[i].first),
+                                            a[i].second));
+             return ret;
+           }, "Get a random set of atom assignments from all the system "
+           "possibilities. The forced positions are pairs of atomic numbers "
+           "and handles from RandSpg.getWyckHandleFromWyckLet()");
+
+  py::class_<SystemPossibilityCache>(m, "SystemPossibilityCache", "Static "
+                                     "class that keeps the system "
+                                     "possibilities of recently generated "
+                                     "spacegroups and compositions.")
+      .def_static("setMaxSize", &SystemPossibilityCache::setMaxSize, "Set "
+                  "the maximum number of spacegroups and compositions to "
+                  "keep. Default is 256.")
+      .def_static("getMaxSize", &SystemPossibilityCache::getMaxSize, "Get "
+                  "the maximum number of spacegroups and compositions to "
+                  "keep")
+      .def_static("size", &SystemPossibilityCache::size, "Get the number of "
+                  "spacegroups and compositions being kept")
+      .def_static("clear", &SystemPossibilityCache::clear, "Remove everything "
+                  "from the cache");
 }
@@ -0,0 +1,167 @@
+/**********************************************************************
+  atomAssignmentSampler.cpp - Class for drawing random atom assignments
+                              from the system possibilities of a sampler
+                              without copying them
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <iostream>
+
+#include "atomAssignmentSampler.h"
+#include "rng.h"
+
+using namespace std;
+
+AtomAssignmentSampler::AtomAssignmentSampler(
+                 const SystemPossibilitySampler& sampler,
+                 const vector<numAndType>& numOfEachType,
+                 const vector<pair<uint, wyckHandle>>& forcedWyckPositions) :
+  m_sampler(sampler),
+  m_atomicNums(),
+  m_forced(forcedWyckPositions),
+  m_forcedTypes(),
+  m_positions(),
+  m_groupStart(),
+  m_choices(),
+  m_states(),
+  m_numToChoose()
+{
+  for (size_t i = 0; i < numOfEachType.size(); i++)
+    m_atomicNums.push_back(numOfEachType[i].second);
+
+  for (size_t i = 0; i < m_forced.size(); i++) {
+    size_t typeIndex = 0;
+    while (typeIndex < m_atomicNums.size() &&
+           m_atomicNums[typeIndex] != m_forced[i].first) {
+      typeIndex++;
+    }
+    m_forcedTypes.push_back(typeIndex);
+  }
+
+  const vector<SystemPossibilitySampler::wyckGroup>& groups =
+    m_sampler.m_groups;
+  for (size_t i = 0; i < groups.size(); i++) {
+    m_groupStart.push_back(m_positions.size());
+    m_positions.insert(m_positions.end(), groups[i].positions.begin(),
+                       groups[i].positions.end());
+  }
+  m_groupStart.push_back(m_positions.size());
+
+  m_numToChoose.resize(m_atomicNums.size() * groups.size());
+}
+
+bool AtomAssignmentSampler::getRandomAtomAssignments(
+                                               atomAssignments& assignments)
+{
+  assignments.clear();
+
+  double num = m_sampler.getNumPossibilities();
+  if (num == 0.0) return false;
+
+  if (!m_sampler.findChoices(m_sampler.getRandomIndex(num), m_choices,
+                             m_states)) {
+    return false;
+  }
+
+  const vector<SystemPossibilitySampler::wyckGroup>& groups =
+    m_sampler.m_groups;
+  const size_t numGroups = groups.size();
+  const size_t numTypes = m_choices.size();
+
+  for (size_t i = 0; i < numTypes; i++) {
+    const SystemPossibilitySampler::groupUsage& usage =
+      m_sampler.m_usages[i][m_choices[i]];
+    for (size_t j = 0; j < numGroups; j++)
+      m_numToChoose[i * numGroups + j] = usage[j];
+  }
+
+  // Add the forced Wyckoff positions. Each one takes the place of one of
+  // the atoms of the first group of its atom type that contains it.
+  for (size_t i = 0; i < m_forced.size(); i++) {
+    assignments.push_back(make_pair(m_forced[i].second, m_forced[i].first));
+
+    size_t typeIndex = m_forcedTypes[i];
+    if (typeIndex >= numTypes) continue;
+    const SystemPossibilitySampler::groupUsage& usage =
+      m_sampler.m_usages[typeIndex][m_choices[typeIndex]];
+    bool decrementComplete = false;
+    for (size_t j = 0; j < numGroups && !decrementComplete; j++) {
+      if (usage[j] == 0) continue;
+      for (size_t k = m_groupStart[j]; k < m_groupStart[j + 1]; k++) {
+        if (m_positions[k] != m_forced[i].second) continue;
+        uint& numToChoose = m_numToChoose[typeIndex * numGroups + j];
+        // This happens if more forced positions share the group than it
+        // has atoms
+        if (numToChoose == 0) {
+          cout << "Error in " << __FUNCTION__ << ": too many forced "
+               << "positions for atomic number " << m_forced[i].first
+               << "!\n";
+          assignments.clear();
+          return false;
+        }
+        numToChoose--;
+        decrementComplete = true;
+        break;
+      }
+    }
+  }
+
+  // A bit for each unique position that has been used. No spacegroup has
+  // more than 64 Wyckoff positions.
+  uint64_t used = 0;
+  for (size_t i = 0; i < numTypes; i++) {
+    for (size_t j = 0; j < numGroups; j++) {
+      uint atomsLeft = m_numToChoose[i * numGroups + j];
+      if (atomsLeft == 0) continue;
+
+      bool unique = groups[j].unique;
+      size_t start = m_groupStart[j];
+      size_t end = m_groupStart[j + 1];
+      // Keep adding atoms until there are none left
+      while (atomsLeft > 0) {
+        int numAvailable = 0;
+        for (size_t k = start; k < end; k++) {
+          if (!(used >> RandSpg::getWyckHandleIndex(m_positions[k]) & 1))
+            numAvailable++;
+        }
+        if (numAvailable == 0) {
+          cout << "Error in " << __FUNCTION__ << ": there are no positions "
+               << "left to assign atomic number " << m_atomicNums[i]
+               << " to!\n";
+          assignments.clear();
+          return false;
+        }
+
+        // Find the position at the random index among the ones that are
+        // still available
+        int rand = getRandInt(0, numAvailable - 1);
+        wyckHandle pos = 0;
+        for (size_t k = start; k < end; k++) {
+          if (used >> RandSpg::getWyckHandleIndex(m_positions[k]) & 1)
+            continue;
+          if (rand-- == 0) {
+            pos = m_positions[k];
+            break;
+          }
+        }
+
+        assignments.push_back(make_pair(pos, m_atomicNums[i]));
+        atomsLeft--;
+        // If we used a unique position, it may not be used again
+        if (unique) used |= uint64_t(1) << RandSpg::getWyckHandleIndex(pos);
+      }
+    }
+  }
+
+  return true;
+}
@@ -21,6 +21,8 @@
 #include <cmath>
 // for writing to POSCAR
 #include <fstream>
+// for std::find()
+#include <algorithm>
 
 #include "crystal.h"
 #include "randSpg.h"
@@ -36,6 +38,23 @@ using namespace std;
 //#define CENTER_CELL_DEBUG
 //#define IAD_DEBUG
 
+static inline double dot(const double a[3], const double b[3])
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void cross(const double a[3], const double b[3], double c[3])
+{
+  c[0] = a[1] * b[2] - a[2] * b[1];
+  c[1] = a[2] * b[0] - a[0] * b[2];
+  c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double norm(const double a[3])
+{
+  return sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+}
+
 Crystal::Crystal(latticeStruct l, vector<atomStruct> a, bool usingVdwRad) :
   m_lattice(l),
   m_atoms(a),
@@ -43,7 +62,13 @@ Crystal::Crystal(latticeStruct l, vector<atomStruct> a, bool usingVdwRad) :
   m_volume(-1.0), // These will be cached when the getter is called
   m_usingVdwRadii(usingVdwRad),
   m_cartConvMatCached(false),
-  m_cartConvMat{}
+  m_cartConvMat{},
+  m_cellListCutoff(0.0),
+  m_cellListBuilt(false),
+  m_cellListDims{},
+  m_atomArraysBuilt(false),
+  m_numAtomsWithUnknownType(0),
+  m_positionHashBuilt(false)
 {
 
 }
@@ -53,7 +78,29 @@ void Crystal::removeAtomAt(size_t i)
   if (i >= m_atoms.size())
     std::cout << "Error: tried to remove an atom at index " << i << " and the "
               << "size is only " << m_atoms.size() << "!\n";
-  else m_atoms.erase(m_atoms.begin() + i);
+  else {
+    // Only the last atom can be removed from the cell list without having
+    // to re-index the bins
+    if (m_cellListBuilt && i == m_atoms.size() - 1 && !m_cellList.empty()) {
+      vector<uint>& bin = m_cellList[getCellListBinIndex(m_atoms[i])];
+      bin.erase(std::find(bin.begin(), bin.end(), i));
+    }
+    else m_cellListBuilt = false;
+    // Same for the atom arrays
+    if (m_atomArraysBuilt && i == m_atoms.size() - 1) {
+      if (m_atomTypes.back() == -1) m_numAtomsWithUnknownType--;
+      m_atomsX.pop_back();
+      m_atomsY.pop_back();
+      m_atomsZ.pop_back();
+      m_atomTypes.pop_back();
+    }
+    else m_atomArraysBuilt = false;
+    // And the position hash
+    if (m_positionHashBuilt && i == m_atoms.size() - 1)
+      m_positionHash.erase(m_atoms[i].x, m_atoms[i].y, m_atoms[i].z, i);
+    else m_positionHashBuilt = false;
+    m_atoms.erase(m_atoms.begin() + i);
+  }
 }
 
 void Crystal::removeAtom(const atomStruct& as)
@@ -70,12 +117,10 @@ void Crystal::removeAtom(const atomStruct& as)
 void Crystal::removeAllNewAtomsSince(const atomStruct& as)
 {
   // Since atoms get appended to the vector in order, we assume all indices
-  // including and greater than our current one are new
-  for (size_t i = getAtomIndexNum(as) + 1; i < m_atoms.size(); i++) {
-    removeAtomAt(i);
-    // size will keep going down until we stop
-    i--;
-  }
+  // including and greater than our current one are new. Remove them from
+  // the back.
+  size_t ind = getAtomIndexNum(as);
+  while (m_atoms.size() > ind + 1) removeAtomAt(m_atoms.size() - 1);
 }
 
 static inline bool atomsHaveSamePosition(const atomStruct& a1,
@@ -110,31 +155,53 @@ static inline void wrapAtomToCell(atomStruct& as)
 void Crystal::wrapAtomsToCell()
 {
   for (size_t i = 0; i < m_atoms.size(); i++) wrapAtomToCell(m_atoms[i]);
+  invalidateAtomCaches();
 }
 
 void Crystal::removeAtomsWithSameCoordinates()
 {
+  // An atom is kept if it is not at the same position as an atom that was
+  // kept before it
+  vector<atomStruct> keep;
+  PositionHash hash(MIN_DOUBLE);
   for (size_t i = 0; i < m_atoms.size(); i++) {
-    for (size_t j = i + 1; j < m_atoms.size(); j++) {
-      if (atomsHaveSamePosition(m_atoms[i], m_atoms[j])) {
-        removeAtomAt(j);
-        j--;
-      }
-    }
+    const atomStruct& as = m_atoms[i];
+    bool duplicate = hash.findNear(as.x, as.y, as.z, [&](size_t j)
+    {
+      return atomsHaveSamePosition(as, keep[j]);
+    });
+    if (duplicate) continue;
+    hash.insert(as.x, as.y, as.z, keep.size());
+    keep.push_back(as);
   }
+
+  if (keep.size() != m_atoms.size()) setAtoms(keep);
+}
+
+void Crystal::buildPositionHash() const
+{
+  if (m_positionHashBuilt) return;
+
+  m_positionHash.clear();
+  for (size_t i = 0; i < m_atoms.size(); i++)
+    m_positionHash.insert(m_atoms[i].x, m_atoms[i].y, m_atoms[i].z, i);
+  m_positionHashBuilt = true;
+}
+
+bool Crystal::isPositionTaken(const atomStruct& as) const
+{
+  buildPositionHash();
+  return m_positionHash.findNear(as.x, as.y, as.z, [&](size_t i)
+  {
+    return atomsHaveSamePosition(as, m_atoms[i]) &&
+           as.atomicNum == m_atoms[i].atomicNum;
+  });
 }
 
 bool Crystal::addAtomIfPositionIsEmpty(atomStruct& as)
 {
   wrapAtomToCell(as);
-  bool positionIsEmpty = true;
-  for (size_t i = 0; i < m_atoms.size(); i++) {
-    if (atomsHaveSamePosition(as, m_atoms[i]) &&
-        as.atomicNum == m_atoms[i].atomicNum) {
-      positionIsEmpty = false;
-      break;
-    }
-  }
+  bool positionIsEmpty = !isPositionTaken(as);
 
   if (positionIsEmpty) {
     addAtom(as);
@@ -253,9 +320,116 @@ void Crystal::cacheCartConvMat() const
   m_cartConvMat[4] = m_lattice.c * (cos(alpha) - cos(beta) * cos(gamma)) / sin(gamma);
   m_cartConvMat[5] = m_lattice.c * v / sin(gamma);
 
+  // The lattice vectors are the columns of the conversion matrix
+  const double* m = m_cartConvMat;
+  double vecs[3][3] = {{m[0], 0.0,  0.0},
+                       {m[1], m[3], 0.0},
+                       {m[2], m[4], m[5]}};
+  double volume = fabs(m[0] * m[3] * m[5]);
+  for (size_t i = 0; i < 3; i++) {
+    double normal[3];
+    cross(vecs[(i + 1) % 3], vecs[(i + 2) % 3], normal);
+    m_cellHeights[i] = volume / norm(normal);
+  }
+
+  cacheReducedBasis();
+
   m_cartConvMatCached = true;
 }
 
+// Reduce the lattice vectors by repeatedly subtracting integer multiples of
+// one vector from another (pairwise Lagrange-Gauss reduction) until no
+// vector can be shortened this way. This is a greedy approximation of
+// Niggli reduction. The minimum-image search does not rely on the basis being
+// perfectly reduced: it only becomes a little slower if it is not.
+void Crystal::cacheReducedBasis() const
+{
+  const double* m = m_cartConvMat;
+  double (*b)[3] = m_reducedBasis;
+  b[0][0] = m[0]; b[0][1] = 0.0;  b[0][2] = 0.0;
+  b[1][0] = m[1]; b[1][1] = m[3]; b[1][2] = 0.0;
+  b[2][0] = m[2]; b[2][1] = m[4]; b[2][2] = m[5];
+
+  // Every change strictly shortens a vector, so this terminates. The limit
+  // is just a safeguard against bad lattices.
+  bool changed = true;
+  for (size_t iter = 0; changed && iter < 100; iter++) {
+    changed = false;
+    for (size_t i = 0; i < 3; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        if (i == j) continue;
+        double mu = dot(b[i], b[j]) / dot(b[j], b[j]);
+        if (fabs(mu) <= 0.5) continue;
+        double r = round(mu);
+        for (size_t k = 0; k < 3; k++) b[i][k] -= r * b[j][k];
+        changed = true;
+      }
+    }
+  }
+
+  // The rows of the inverse are the reciprocal vectors, and the heights of
+  // the cell are the inverses of their lengths
+  double normals[3][3];
+  for (size_t i = 0; i < 3; i++)
+    cross(b[(i + 1) % 3], b[(i + 2) % 3], normals[i]);
+  double vol = dot(b[0], normals[0]);
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t k = 0; k < 3; k++)
+      m_reducedBasisInv[i][k] = normals[i][k] / vol;
+    m_reducedHeights[i] = fabs(vol) / norm(normals[i]);
+  }
+}
+
+double Crystal::getMinImageDistanceSquared(double dx, double dy, double dz,
+                                           double cutoff) const
+{
+  if (!m_cartConvMatCached) cacheCartConvMat();
+  const double* m = m_cartConvMat;
+  const double (*b)[3] = m_reducedBasis;
+  const double (*bInv)[3] = m_reducedBasisInv;
+
+  // Convert to a cartesian vector, and then remove the whole reduced lattice
+  // vectors from it
+  double v[3] = {dx * m[0] + dy * m[1] + dz * m[2],
+                 dy * m[3] + dz * m[4],
+                 dz * m[5]};
+  double shift[3];
+  for (size_t i = 0; i < 3; i++) shift[i] = round(dot(bInv[i], v));
+  for (size_t k = 0; k < 3; k++)
+    v[k] -= shift[0] * b[0][k] + shift[1] * b[1][k] + shift[2] * b[2][k];
+
+  double best = dot(v, v);
+  if (cutoff < 0.0) cutoff = sqrt(best);
+
+  // Each component of v along the reduced basis is now within [-0.5, 0.5].
+  // An image closer than the cutoff cannot be more than
+  // cutoff / height + 0.5 lattice vectors away along any of them.
+  int n[3];
+  for (size_t i = 0; i < 3; i++)
+    n[i] = static_cast<int>(floor(cutoff / m_reducedHeights[i] + 0.5));
+
+  for (int i = -n[0]; i <= n[0]; i++) {
+    for (int j = -n[1]; j <= n[1]; j++) {
+      for (int k = -n[2]; k <= n[2]; k++) {
+        if (i == 0 && j == 0 && k == 0) continue;
+        double image[3];
+        for (size_t l = 0; l < 3; l++)
+          image[l] = v[l] + i * b[0][l] + j * b[1][l] + k * b[2][l];
+        double distSquared = dot(image, image);
+        if (distSquared < best) best = distSquared;
+      }
+    }
+  }
+  return best;
+}
+
+double Crystal::getMinImageDistance(const atomStruct& as1,
+                                    const atomStruct& as2) const
+{
+  return sqrt(getMinImageDistanceSquared(as2.x - as1.x, as2.y - as1.y,
+                                         as2.z - as1.z));
+}
+
 void Crystal::rescaleVolume(double newVolume)
 {
   if (newVolume < 0) {
@@ -299,18 +473,11 @@ double Crystal::findNearestNeighborAtomAndDistance(const atomStruct& as,
     return 0;
   }
 
-  Crystal tempCrystal = *this;
-
-  // We need to center the cell around this atom so that we don't run into the
-  // problem of missing short distances caused by periodicity
-  tempCrystal.centerCellAroundAtom(ind);
-
   size_t neighborInd = 0;
   double smallestDistance = 1000000.00;
-  vector<atomStruct> tempAtoms = tempCrystal.getAtoms();
-  for (size_t i = 0; i < tempAtoms.size(); i++) {
+  for (size_t i = 0; i < m_atoms.size(); i++) {
     if (i == ind) continue;
-    double newDistance = getDistance(tempAtoms[ind], tempAtoms[i]);
+    double newDistance = getMinImageDistance(m_atoms[ind], m_atoms[i]);
     if (newDistance < smallestDistance) {
       smallestDistance = newDistance;
       neighborInd = i;
@@ -393,50 +560,84 @@ bool Crystal::fillCellWithAtom(uint spg, const atomStruct& as)
     return false;
   }
 
-  vector<string> dupVec = RandSpg::getVectorOfDuplications(spg);
-  vector<string> fpVec = RandSpg::getVectorOfFillPositions(spg);
+  const vector<affineTransform>& ops = RandSpg::getSymmetryOperations(spg);
 
   double x = as.x;
   double y = as.y;
   double z = as.z;
   uint atomicNum = as.atomicNum;
-  for (size_t j = 0; j < dupVec.size(); j++) {
-    // First, we are going to set up the duplicate vector components
-
-    vector<string> dupComponents = split(dupVec[j], ',');
-
-    // These are all just numbers, so we can just convert them
-    double dupX = stof(dupComponents[0]);
-    double dupY = stof(dupComponents[1]);
-    double dupZ = stof(dupComponents[2]);
-
-    // Next, we are going to loop through all fill positions
-    for (size_t k = 0; k < fpVec.size(); k++) {
-      // Skip the first one if we are at j = 0. It is always just (x,y,z)
-      if (j == 0 && k == 0) continue;
-      vector<string> fpComponents = split(fpVec[k], ',');
-
-      double newX = RandSpg::interpretComponent(fpComponents[0],
-                                                x, y, z) + dupX;
-      double newY = RandSpg::interpretComponent(fpComponents[1],
-                                                x, y, z) + dupY;
-      double newZ = RandSpg::interpretComponent(fpComponents[2],
-                                                x, y, z) + dupZ;
-
-      atomStruct newAtom(atomicNum, newX, newY, newZ);
-
-      if (addAtomIfPositionIsEmpty(newAtom)) {
-        // Check IADs. If IADs are not good, clean up and return false.
-        if (!areIADsOkay(newAtom)) {
-          removeAllNewAtomsSince(as);
-          return false;
-        }
+  // Skip the first operation. It is always the identity.
+  for (size_t i = 1; i < ops.size(); i++) {
+    double newX, newY, newZ;
+    ops[i].apply(x, y, z, newX, newY, newZ);
+
+    atomStruct newAtom(atomicNum, newX, newY, newZ);
+
+    if (addAtomIfPositionIsEmpty(newAtom)) {
+      // Check IADs. If IADs are not good, clean up and return false.
+      if (!areIADsOkay(newAtom)) {
+        removeAllNewAtomsSince(as);
+        return false;
       }
     }
   }
   return true;
 }
 
+bool Crystal::addAtomAndOrbitIfIADsAreOkay(uint spg, const atomStruct& as)
+{
+  const vector<affineTransform>& ops = RandSpg::getSymmetryOperations(spg);
+
+  // The orbit is built in the scratch buffer. The crystal is not touched
+  // until the whole orbit has passed.
+  vector<atomStruct>& orbit = m_orbitScratch;
+  PositionHash& orbitHash = m_orbitHash;
+  orbit.clear();
+  orbitHash.clear();
+
+  if (!areIADsOkay(as, m_atoms.size())) return false;
+  orbit.push_back(as);
+  orbitHash.insert(as.x, as.y, as.z, 0);
+
+  // Skip the first operation. It is always the identity.
+  for (size_t i = 1; i < ops.size(); i++) {
+    atomStruct newAtom(as.atomicNum, 0.0, 0.0, 0.0);
+    ops[i].apply(as.x, as.y, as.z, newAtom.x, newAtom.y, newAtom.z);
+    wrapAtomToCell(newAtom);
+
+    // Images that land on an atom that is already there are skipped
+    if (isPositionTaken(newAtom)) continue;
+    // Every atom in the orbit has the same type
+    bool inOrbit = orbitHash.findNear(newAtom.x, newAtom.y, newAtom.z,
+                                      [&](size_t j)
+    {
+      return atomsHaveSamePosition(newAtom, orbit[j]);
+    });
+    if (inOrbit) continue;
+
+    // Check the IADs against the crystal and the rest of the orbit
+    if (!areIADsOkay(newAtom, m_atoms.size())) return false;
+
+    const double* minIADsSquared = getMinIADsSquaredRow(newAtom);
+    for (size_t j = 0; j < orbit.size(); j++) {
+      const atomStruct& other = orbit[j];
+      double minIADSquared = getMinIADSquared(newAtom, other, minIADsSquared);
+      double distSquared = getMinImageDistanceSquared(other.x - newAtom.x,
+                                                      other.y - newAtom.y,
+                                                      other.z - newAtom.z,
+                                                      sqrt(minIADSquared));
+      if (distSquared < minIADSquared) return false;
+    }
+
+    orbitHash.insert(newAtom.x, newAtom.y, newAtom.z, orbit.size());
+    orbit.push_back(newAtom);
+  }
+
+  // Success! Commit the orbit.
+  for (size_t i = 0; i < orbit.size(); i++) addAtom(orbit[i]);
+  return true;
+}
+
 bool Crystal::fillUnitCell(uint spg)
 {
 #ifdef CRYSTAL_DEBUG
@@ -460,6 +661,11 @@ bool Crystal::fillUnitCell(uint spg)
 // Radii should have already been scaled and set before calling this
 double Crystal::getMinIAD(const atomStruct& as1, const atomStruct& as2) const
 {
+  if (m_minIADTable) {
+    double minIAD = m_minIADTable->getMinIAD(as1.atomicNum, as2.atomicNum);
+    if (minIAD != -1.0) return minIAD;
+  }
+
   // Check to see if we have a custom IAD and return it if we do
   if (ElemInfo::customMinIAD(as1.atomicNum, as2.atomicNum) != -1.0)
     return ElemInfo::customMinIAD(as1.atomicNum, as2.atomicNum);
@@ -478,30 +684,205 @@ bool Crystal::areIADsOkay() const
   return true;
 }
 
-bool Crystal::areIADsOkay(const atomStruct& as) const
+// The bin along one axis for a fractional coordinate
+static inline int getCellListBin(double u, int numBins)
 {
-  Crystal tempCrystal = *this;
+  int bin = static_cast<int>((u - floor(u)) * numBins);
+  return (bin < numBins) ? bin : numBins - 1;
+}
 
-  size_t ind = getAtomIndexNum(as);
+size_t Crystal::getCellListBinIndex(const atomStruct& as) const
+{
+  const int* dims = m_cellListDims;
+  return (getCellListBin(as.x, dims[0]) * dims[1] +
+          getCellListBin(as.y, dims[1])) * dims[2] +
+          getCellListBin(as.z, dims[2]);
+}
 
-  // We need to center the cell around this atom so that we don't run into the
-  // problem of missing short distances caused by periodicity
-  tempCrystal.centerCellAroundAtom(ind);
+bool Crystal::buildCellList() const
+{
+  if (m_cellListCutoff <= 0.0) return false;
+  if (m_cellListBuilt) return !m_cellList.empty();
 
-  const vector<atomStruct>& temp = tempCrystal.getAtoms();
-  for (size_t i = 0; i < temp.size(); i++) {
-    if (i == ind) continue;
-    double minIAD = getMinIAD(temp[ind], temp[i]);
-    double dist = getDistance(temp[ind], temp[i]);
+  m_cellListBuilt = true;
+  m_cellList.clear();
+
+  if (!m_cartConvMatCached) cacheCartConvMat();
+
+  // The bins must be at least as wide as the cutoff in the direction
+  // perpendicular to each pair of lattice vectors. We need at least 3 bins
+  // along every axis so that the 27 neighboring bins are all different.
+  // There is no need for a huge number of bins, though.
+  const int maxDim = 32;
+  for (size_t i = 0; i < 3; i++) {
+    int dim = static_cast<int>(m_cellHeights[i] / m_cellListCutoff);
+    if (dim < 3) return false;
+    m_cellListDims[i] = (dim < maxDim) ? dim : maxDim;
+  }
+
+  m_cellList.resize(m_cellListDims[0] * m_cellListDims[1] *
+                    m_cellListDims[2]);
+  for (size_t i = 0; i < m_atoms.size(); i++) addToCellList(i);
+  return true;
+}
+
+void Crystal::addToCellList(size_t i) const
+{
+  if (m_cellList.empty()) return;
+  m_cellList[getCellListBinIndex(m_atoms[i])].push_back(i);
+}
+
+bool Crystal::areIADsOkayUsingCellList(const atomStruct& as,
+                                        size_t skip) const
+{
+  const int* dims = m_cellListDims;
+  const double* m = m_cartConvMat;
+
+  // Work with the wrapped position of the atom
+  double pos[3] = {as.x - floor(as.x), as.y - floor(as.y), as.z - floor(as.z)};
+  int bin[3] = {getCellListBin(as.x, dims[0]),
+                getCellListBin(as.y, dims[1]),
+                getCellListBin(as.z, dims[2])};
+  const double* minIADsSquared = getMinIADsSquaredRow(as);
+
+  for (int i = -1; i <= 1; i++) {
+    for (int j = -1; j <= 1; j++) {
+      for (int k = -1; k <= 1; k++) {
+        // Find the neighboring bin. If it is across the boundary of the
+        // cell, the atoms in it need to be shifted by a lattice vector.
+        int offsets[3] = {i, j, k};
+        int neighbor[3];
+        double shift[3];
+        for (size_t l = 0; l < 3; l++) {
+          neighbor[l] = bin[l] + offsets[l];
+          shift[l] = 0.0;
+          if (neighbor[l] < 0) {
+            neighbor[l] += dims[l];
+            shift[l] = -1.0;
+          }
+          else if (neighbor[l] >= dims[l]) {
+            neighbor[l] -= dims[l];
+            shift[l] = 1.0;
+          }
+        }
+
+        const vector<uint>& atomsInBin =
+          m_cellList[(neighbor[0] * dims[1] + neighbor[1]) * dims[2] +
+                     neighbor[2]];
+        for (size_t l = 0; l < atomsInBin.size(); l++) {
+          if (atomsInBin[l] == skip) continue;
+          const atomStruct& other = m_atoms[atomsInBin[l]];
+          double dx = other.x - floor(other.x) + shift[0] - pos[0];
+          double dy = other.y - floor(other.y) + shift[1] - pos[1];
+          double dz = other.z - floor(other.z) + shift[2] - pos[2];
+          // Convert to cartesian coordinates
+          double cx = dx * m[0] + dy * m[1] + dz * m[2];
+          double cy = dy * m[3] + dz * m[4];
+          double cz = dz * m[5];
+          if (cx * cx + cy * cy + cz * cz <
+              getMinIADSquared(as, other, minIADsSquared)) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void Crystal::buildAtomArrays() const
+{
+  if (m_atomArraysBuilt) return;
+
+  m_atomsX.clear();
+  m_atomsY.clear();
+  m_atomsZ.clear();
+  m_atomTypes.clear();
+  m_numAtomsWithUnknownType = 0;
+  for (size_t i = 0; i < m_atoms.size(); i++) addToAtomArrays(m_atoms[i]);
+  m_atomArraysBuilt = true;
+}
+
+void Crystal::addToAtomArrays(const atomStruct& as) const
+{
+  int typeIndex = -1;
+  if (m_minIADTable) typeIndex = m_minIADTable->getTypeIndex(as.atomicNum);
+  if (typeIndex == -1) m_numAtomsWithUnknownType++;
+  m_atomsX.push_back(as.x);
+  m_atomsY.push_back(as.y);
+  m_atomsZ.push_back(as.z);
+  m_atomTypes.push_back(typeIndex);
+}
+
+bool Crystal::canUseIADKernel(const atomStruct& as) const
+{
+  if (!m_minIADTable || m_minIADTable->getTypeIndex(as.atomicNum) == -1)
+    return false;
+
+  buildAtomArrays();
+  if (m_numAtomsWithUnknownType != 0) return false;
+
+  // The kernel only looks at the nearest image along each lattice vector.
+  // That is the minimum image for every distance shorter than half of the
+  // smallest height of the cell.
+  if (!m_cartConvMatCached) cacheCartConvMat();
+  double minHeight = min(m_cellHeights[0], min(m_cellHeights[1],
+                                               m_cellHeights[2]));
+  return 2.0 * m_minIADTable->getLargestMinIAD() < minHeight;
+}
+
+bool Crystal::areIADsOkayUsingKernel(const atomStruct& as, size_t skip) const
+{
+  iadKernelAtoms atoms = {m_atomsX.data(), m_atomsY.data(), m_atomsZ.data(),
+                          m_atomTypes.data()};
+  double pos[3] = {as.x, as.y, as.z};
+  const double* minIADsSquared = getMinIADsSquaredRow(as);
+
+  if (skip >= m_atoms.size()) {
+    return !isAnyAtomWithinMinIAD(atoms, 0, m_atoms.size(), pos,
+                                  minIADsSquared, m_cartConvMat);
+  }
+  return !isAnyAtomWithinMinIAD(atoms, 0, skip, pos, minIADsSquared,
+                                m_cartConvMat) &&
+         !isAnyAtomWithinMinIAD(atoms, skip + 1, m_atoms.size(), pos,
+                                minIADsSquared, m_cartConvMat);
+}
 
-    if (dist < minIAD) {
+bool Crystal::areIADsOkay(const atomStruct& as) const
+{
+  return areIADsOkay(as, getAtomIndexNum(as));
+}
+
+bool Crystal::areIADsOkay(const atomStruct& as, size_t skip) const
+{
+  // Checking against every atom with the vectorized kernel is faster than
+  // the cell list until there are quite a few atoms
+  const size_t maxAtomsForKernel = 512;
+  if (canUseIADKernel(as) &&
+      (m_atoms.size() <= maxAtomsForKernel || !buildCellList())) {
+    return areIADsOkayUsingKernel(as, skip);
+  }
+
+  if (buildCellList()) return areIADsOkayUsingCellList(as, skip);
+
+  const double* minIADsSquared = getMinIADsSquaredRow(as);
+  for (size_t i = 0; i < m_atoms.size(); i++) {
+    if (i == skip) continue;
+    const atomStruct& other = m_atoms[i];
+    double minIADSquared = getMinIADSquared(as, other, minIADsSquared);
+    double distSquared = getMinImageDistanceSquared(other.x - as.x,
+                                                    other.y - as.y,
+                                                    other.z - as.z,
+                                                    sqrt(minIADSquared));
+
+    if (distSquared < minIADSquared) {
 #ifdef IAD_DEBUG
       cout << "In " << __FUNCTION__ << ", minIAD failed!\n";
-      cout << "  The distance is " << dist << " and the minIAD is " << minIAD
-           << "\n";
+      cout << "  The distance is " << sqrt(distSquared) << " and the minIAD is "
+           << sqrt(minIADSquared) << "\n";
       cout << "  Atoms responsible for failure are as follows:\n";
       printAtomInfo(as);
-      printAtomInfo(neighbor);
+      printAtomInfo(other);
 #endif
       return false;
     }
@@ -655,18 +1036,9 @@ void Crystal::printIADs() const
   vector<atomStruct> atoms = getAtoms();
   for (size_t i = 0; i < atoms.size(); i++) {
     cout << "For atom with index " << i << " and atomicNum " << atoms[i].atomicNum << ", the following are the neighbors:\n";
-    Crystal tempCrystal = *this;
-
-    // We need to center the cell around this atom so that we don't run into the
-    // problem of missing short distances caused by periodicity
-    tempCrystal.centerCellAroundAtom(i);
-
-    size_t neighborInd = 0;
-    double smallestDistance = 1000000.00;
-    vector<atomStruct> tempAtoms = tempCrystal.getAtoms();
-    for (size_t j = i + 1; j < tempAtoms.size(); j++) {
-      double newDistance = getDistance(tempAtoms[i], tempAtoms[j]);
-      cout << "index " << j << " and atomicNum " << tempAtoms[j].atomicNum << ": " << newDistance << "\n";
+    for (size_t j = i + 1; j < atoms.size(); j++) {
+      double newDistance = getMinImageDistance(atoms[i], atoms[j]);
+      cout << "index " << j << " and atomicNum " << atoms[j].atomicNum << ": " << newDistance << "\n";
     }
   }
 }
@@ -0,0 +1,438 @@
+/**********************************************************************
+  generationPlan.cpp - Class that holds everything about a randSpgInput
+                       that does not change between the crystals generated
+                       from it
+
+  Copyright (C) 2016 by Patrick S. Avery
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <tuple>
+
+#include "atomAssignmentSampler.h"
+#include "generationPlan.h"
+#include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
+#include "rng.h"
+#include "systemPossibilityCache.h"
+#include "systemPossibilityIterator.h"
+
+using namespace std;
+
+// This just converts the second element in the pair (the 'char') to a
+// wyckHandle
+static vector<pair<uint, wyckHandle>>
+getModifiedForcedWyckVector(const vector<pair<uint, char>>& v, uint spg)
+{
+  vector<pair<uint, wyckHandle>> ret;
+  for (size_t i = 0; i < v.size(); i++)
+    ret.push_back(make_pair(v[i].first,
+                      RandSpg::getWyckHandleFromWyckLet(spg, v[i].second)));
+  return ret;
+}
+
+// Convenience function for counting the number of times a forced Wyck
+// assignment is used and storing the information in a vector of tuples
+static vector<tuple<uint, char, uint>>
+getForcedWyckAssignmentsAndNumber(const vector<pair<uint, char>>& forcedWyckAssignments)
+{
+  vector<pair<uint, char>> alreadyUsedForcedWyckAssignments;
+  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
+  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber;
+  for (size_t i = 0; i < forcedWyckAssignments.size(); i++) {
+    // Check to see if we've already looked at this assignment
+    bool alreadyUsed = false;
+    for (size_t j = 0; j < alreadyUsedForcedWyckAssignments.size(); j++) {
+      if (forcedWyckAssignments[i] ==
+          alreadyUsedForcedWyckAssignments[j]) {
+        alreadyUsed = true;
+        break;
+      }
+    }
+    // If we've already looked at it, just continue
+    if (alreadyUsed) continue;
+    // Now count how many times we use this
+    uint numTimesUsed = 1;
+    for (size_t j = i + 1; j < forcedWyckAssignments.size(); j++) {
+      if (forcedWyckAssignments[i] == forcedWyckAssignments[j])
+        numTimesUsed++;
+    }
+    alreadyUsedForcedWyckAssignments.push_back(forcedWyckAssignments[i]);
+    forcedWyckAssignmentsAndNumber.push_back(make_tuple(
+      forcedWyckAssignments[i].first,
+      forcedWyckAssignments[i].second,
+      numTimesUsed));
+  }
+  return forcedWyckAssignmentsAndNumber;
+}
+
+static Crystal createValidCrystal(uint spg, const latticeStruct& latticeMins,
+                                  const latticeStruct& latticeMaxes,
+                                  double minVolume, double maxVolume)
+{
+  // The lattice is drawn directly from the parameters that satisfy the
+  // volume and the mins and maxes, so there is nothing to reject here
+  latticeStruct st = RandSpg::generateLatticeForSpg(spg, latticeMins,
+                                                    latticeMaxes, minVolume,
+                                                    maxVolume);
+
+  // Make sure it's a valid lattice. generateLatticeForSpg() has already
+  // printed why if it is not.
+  if (st.a == 0 || st.b == 0 || st.c == 0 ||
+      st.alpha == 0 || st.beta == 0 || st.gamma == 0) {
+    return Crystal();
+  }
+  return Crystal(st);
+}
+
+// Place the atoms of the assignments in order. If the atoms of a Wyckoff
+// position cannot be placed, the orbits placed before it are removed and
+// placed again, going back at most 'depth' orbits from the furthest one that
+// failed, and placing each one again at most 'retries' times. Every time an
+// orbit is placed again, the orbits after it get their retries back. Since
+// an orbit only gets its retries back when one before it is placed again,
+// this always ends.
+static bool placeAssignments(Crystal& crystal,
+                             const atomAssignments& assignments, uint spg,
+                             uint depth, uint retries)
+{
+  // The number of atoms in the crystal before each orbit was placed
+  vector<size_t> orbitStart(assignments.size(), 0);
+  vector<uint> numRetries(assignments.size(), 0);
+  size_t furthestFailure = 0;
+
+  size_t j = 0;
+  while (j < assignments.size()) {
+    const wyckPos& pos = RandSpg::getWyckPos(assignments[j].first);
+    uint atomicNum = assignments[j].second;
+    orbitStart[j] = crystal.numAtoms();
+    if (RandSpg::addWyckoffAtomRandomly(crystal, pos, atomicNum, spg)) {
+      j++;
+      continue;
+    }
+
+    if (depth == 0) return false;
+    if (j > furthestFailure) furthestFailure = j;
+
+    // Find the last orbit within reach that may be placed again. Unique
+    // positions would just be placed in the same spot.
+    size_t lowest = (furthestFailure > depth) ? furthestFailure - depth : 0;
+    size_t k = j;
+    bool found = false;
+    while (k > lowest) {
+      k--;
+      if (numRetries[k] < retries &&
+          !RandSpg::containsUniquePosition(assignments[k].first)) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) return false;
+
+    numRetries[k]++;
+    for (size_t l = k + 1; l < assignments.size(); l++) numRetries[l] = 0;
+
+    // Remove the orbit and everything after it. Atoms are only ever
+    // appended, so they are removed from the back.
+    while (crystal.numAtoms() > orbitStart[k])
+      crystal.removeAtomAt(crystal.numAtoms() - 1);
+    j = k;
+  }
+  return true;
+}
+
+// How much room the orbit of an assignment takes up: its multiplicity times
+// the cube of the radius of the atom. The radius is half the minIAD of the
+// atom with itself, so custom minIADs count. Unique positions come first no
+// matter what, since they only have one place to go.
+static double getPlacementDifficulty(const atomAssignment& assignment,
+                                     const MinIADTable& minIADTable)
+{
+  if (RandSpg::containsUniquePosition(assignment.first))
+    return numeric_limits<double>::infinity();
+  double radius = 0.5 * minIADTable.getMinIAD(assignment.second,
+                                              assignment.second);
+  if (radius < 0.0) radius = 0.0;
+  return RandSpg::getMultiplicity(assignment.first) *
+         radius * radius * radius;
+}
+
+// Sort the assignments so that the hardest ones to place come first.
+// Assignments that are just as hard keep their order.
+static void orderByDifficulty(atomAssignments& assignments,
+                              const MinIADTable& minIADTable)
+{
+  stable_sort(assignments.begin(), assignments.end(),
+              [&minIADTable](const atomAssignment& a,
+                             const atomAssignment& b)
+  {
+    return getPlacementDifficulty(a, minIADTable) >
+           getPlacementDifficulty(b, minIADTable);
+  });
+}
+
+// Makes the stream of a context the current stream of the thread while it
+// exists. If 'saveStream' is true, the stream is copied back to the context
+// afterwards so that the next call continues where this one stopped.
+class ContextRandStream {
+ public:
+  ContextRandStream(RandSpgContext& context, bool saveStream) :
+    m_context(context),
+    m_saveStream(saveStream),
+    m_scopedStream(context.getRandStream()) {}
+
+  ~ContextRandStream()
+  {
+    if (m_saveStream) m_context.getRandStream() = getRandEngine();
+  }
+
+ private:
+  RandSpgContext& m_context;
+  bool m_saveStream;
+  ScopedRandStream m_scopedStream;
+};
+
+
+GenerationPlan::GenerationPlan(const randSpgInput& input,
+                               const RandSpgContext& context) :
+  m_input(input),
+  m_valid(false),
+  m_numOfEachType(RandSpg::getNumOfEachType(input.atoms)),
+  m_sampler(),
+  m_forcedWyckPositions(),
+  m_minIADTable(),
+  m_cellListCutoff(0.0),
+  m_possibilitiesLog()
+{
+  uint spg = input.spg;
+
+  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
+  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber =
+    getForcedWyckAssignmentsAndNumber(input.forcedWyckAssignments);
+
+  // The system possibilities are counted rather than created, since there
+  // may be very many of them. The counts are cached, since plans are often
+  // built many times for the same spacegroup and composition.
+  m_sampler = SystemPossibilityCache::getSampler(spg, m_numOfEachType,
+                                                 forcedWyckAssignmentsAndNumber,
+                                                 input.forceMostGeneralWyckPos);
+
+  double numPossibilities = m_sampler->getNumPossibilities();
+  if (numPossibilities == 0) {
+    // Find out which of the requirements made it impossible
+    vector<tuple<uint, char, uint>> noForcedWyckAssignments;
+    if (SystemPossibilityCache::getSampler(spg, m_numOfEachType,
+                                           noForcedWyckAssignments,
+                                           false)->getNumPossibilities() == 0) {
+      cout << "Error in RandSpg::randSpgCrystal(): this spg '" << spg
+           << "' cannot be generated with this composition\n";
+    }
+    else if (SystemPossibilityCache::getSampler(
+               spg, m_numOfEachType, noForcedWyckAssignments,
+               input.forceMostGeneralWyckPos)->getNumPossibilities() == 0) {
+      cout << "Error in RandSpg::randSpgCrystal(): this spg '" << spg
+           << "' cannot be generated with this composition.\n";
+      cout << "It can be generated if option 'forceMostGeneralWyckPos' is "
+           << "turned off, but the correct spacegroup will not be guaranteed.\n";
+    }
+    else {
+      cout << "Error in RandSpg::randSpgCrystal(): this spg '" << spg
+           << "' cannot be generated with this composition due to the forced "
+           << "Wyckoff position constraints.\nPlease change them or remove them "
+           << "if you wish to generate the space group.\n";
+    }
+    return;
+  }
+
+  // If we desire verbose output, the system possibilities are printed to the
+  // log file before every crystal. Only print them all if there are not too
+  // many.
+  if (input.verbosity == 'v') {
+    const double maxNumToPrint = 10000;
+    stringstream ss;
+    if (numPossibilities <= maxNumToPrint) {
+      ss << "Printing system possibilities:\n";
+      size_t index = 0;
+      for (SystemPossibilityIterator it(*m_sampler); !it.atEnd();
+           it.next(), index++) {
+        systemPossibility pos = *it;
+        SystemPossibilityCache::relabel(pos, m_numOfEachType);
+        ss << RandSpgCombinatorics::getVerbosePossibilityString(pos, index);
+      }
+    }
+    else {
+      ss << "There are " << numPossibilities << " system possibilities. "
+         << "That is too many to print.\n";
+    }
+    m_possibilitiesLog = ss.str();
+  }
+
+  m_forcedWyckPositions =
+    getModifiedForcedWyckVector(input.forcedWyckAssignments, spg);
+
+  // Find the minIADs of this composition from the radii and custom minIADs
+  // of the context. The table is shared by every crystal we make. The cell
+  // list used for the IAD checks only needs to find neighbors within the
+  // largest of the minIADs.
+  m_minIADTable = context.createMinIADTable(input.atoms);
+  m_cellListCutoff = m_minIADTable->getLargestMinIAD();
+
+  m_valid = true;
+}
+
+double GenerationPlan::getNumPossibilities() const
+{
+  return m_sampler ? m_sampler->getNumPossibilities() : 0.0;
+}
+
+Crystal GenerationPlan::generate(RandSpgContext& context,
+                                 uint structureIndex) const
+{
+  if (!m_valid) return Crystal();
+
+  // Convenience: so we don't have to say 'm_input.<option>' for every call
+  uint spg                                                      = m_input.spg;
+  const vector<uint>& atoms                                     = m_input.atoms;
+  const latticeStruct& latticeMins                              = m_input.latticeMins;
+  const latticeStruct& latticeMaxes                             = m_input.latticeMaxes;
+  double minVolume                                              = m_input.minVolume;
+  double maxVolume                                              = m_input.maxVolume;
+  char verbosity                                                = m_input.verbosity;
+  int numAttempts                                               = m_input.maxAttempts;
+
+  // Draw from the stream of the context. If a seed was given, every attempt
+  // below draws from its own stream instead, and the stream of the context
+  // is left alone. The stream of the calling thread is restored when we are
+  // done.
+  ContextRandStream contextStream(context, m_input.seed == 0);
+
+  if (verbosity == 'v') context.appendToLog(m_possibilitiesLog);
+
+  // The atom assignments of every attempt are drawn from this. It has
+  // scratch space, so every call has its own.
+  AtomAssignmentSampler assignmentSampler(*m_sampler, m_numOfEachType,
+                                          m_forcedWyckPositions);
+  atomAssignments assignments;
+  bool latticeImpossible = false;
+
+  // Begin the attempt loop!
+  for (int i = 0; i < numAttempts; i++) {
+
+    // Select the stream for this attempt so that it is reproducible
+    if (m_input.seed != 0)
+      setRandStream(RandStream(m_input.seed, spg, structureIndex, i));
+
+    Crystal crystal = createValidCrystal(spg, latticeMins, latticeMaxes,
+                                         minVolume, maxVolume);
+
+    // Without a lattice, there is nowhere to place the atoms. The lattice
+    // is drawn from the constraints directly, so it only fails if they
+    // cannot be met. That is certain outside of triclinic and monoclinic,
+    // and for those, generateLatticeForSpg() has already tried many angles.
+    // So no later attempt would find a lattice either.
+    if (crystal.getVolume() == 0) {
+      latticeImpossible = true;
+      break;
+    }
+
+    crystal.setMinIADTable(m_minIADTable);
+    crystal.setCellListCutoff(m_cellListCutoff);
+
+    // Now, let's assign some atoms!
+    assignmentSampler.getRandomAtomAssignments(assignments);
+    if (m_input.placeByDifficulty)
+      orderByDifficulty(assignments, *m_minIADTable);
+
+    //printAtomAssignments(assignments);
+    // If we desire any output, print the atom assignments to the log file
+    if (verbosity == 'r' || verbosity == 'v')
+      context.appendToLog(RandSpg::getAtomAssignmentsString(assignments));
+
+    if (assignments.size() == 0) {
+      cout << "Error in RandSpg::randSpgXtal(): atoms were not successfully"
+           << " assigned positions in assignAtomsToWyckPos()\n";
+      continue;
+    }
+
+#ifdef RANDSPG_DEBUG
+    cout << "\natomAssignments are the following (atomicNum, wyckLet, wyckPos):"
+         << "\n";
+    for (size_t j = 0; j < assignments.size(); j++)
+      cout << "  " << assignments[j].second << ", "
+           << RandSpg::getWyckLet(assignments[j].first)
+           << ", " << RandSpg::getWyckCoords(assignments[j].first) << "\n";
+    cout << "\n";
+#endif
+
+    bool assignmentsSuccessful =
+      placeAssignments(crystal, assignments, spg, m_input.backtrackDepth,
+                       m_input.backtrackRetries);
+
+    // If we succeeded, and the number of atoms match, return the crystal!
+    // There are rare cases where an atom may be placed on top of another
+    // one and the essentially get merged into one. We check to make sure the
+    // sizes of the atomic numbers match for this reason. We shouldn't have to
+    // worry about types.
+    if (assignmentsSuccessful &&
+        atoms.size() == crystal.getVectorOfAtomicNums().size()) {
+      if (verbosity != 'n') context.appendToLog("*** Success! ***\n");
+      return crystal;
+    }
+    else {
+      if (verbosity == 'r' || verbosity == 'v') {
+        stringstream ss;
+        ss << "Failed to add atoms to satisfy MinIAD.\nObtaining new atom "
+           << "assignments and trying again. Failure count: " << i + 1 << "\n\n";
+        context.appendToLog(ss.str());
+      }
+      continue;
+    }
+  }
+
+  // If we made it here, we failed to generate the crystal
+  stringstream errMsg;
+  if (latticeImpossible) {
+    errMsg << "No lattice satisfies the lattice and volume constraints: "
+           << "failed to generate a crystal of spg " << spg << ".\n";
+  }
+  else {
+    errMsg << "After " << numAttempts << " attempts: failed to generate "
+           << "a crystal of spg " << spg << ".\n";
+  }
+  if (verbosity != 'n') context.appendToLog(errMsg.str());
+  cerr << errMsg.str();
+  return Crystal();
+}
+
+vector<Crystal> GenerationPlan::generate(size_t n,
+                                         RandSpgContext& context) const
+{
+  vector<Crystal> crystals;
+  crystals.reserve(n);
+  for (size_t i = 0; i < n; i++)
+    crystals.push_back(generate(context, m_input.structureIndex + i));
+  return crystals;
+}
+
+vector<Crystal> GenerationPlan::generate(size_t n) const
+{
+  // The context starts with the current stream of this thread. Continue
+  // from where it stopped so that unseeded calls keep drawing new numbers.
+  RandSpgContext context(m_input);
+  vector<Crystal> crystals = generate(n, context);
+  setRandStream(context.getRandStream());
+  return crystals;
+}
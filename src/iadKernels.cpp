@@ -0,0 +1,193 @@
+/**********************************************************************
+  iadKernels.cpp - Vectorized kernels for checking one atom against many
+                   atoms for interatomic distance failures
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <cmath>
+
+#include "iadKernels.h"
+
+// Only GCC and Clang on x86 can compile the AVX kernels without compiling
+// the whole library for them
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define RANDSPG_IAD_KERNEL_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef bool (*iadKernel)(const iadKernelAtoms&, size_t, size_t,
+                          const double*, const double*, const double*);
+
+static bool isAnyAtomWithinMinIADScalar(const iadKernelAtoms& atoms,
+                                        size_t begin, size_t end,
+                                        const double* pos,
+                                        const double* minIADsSquared,
+                                        const double* m)
+{
+  for (size_t i = begin; i < end; i++) {
+    double dx = atoms.x[i] - pos[0];
+    double dy = atoms.y[i] - pos[1];
+    double dz = atoms.z[i] - pos[2];
+    dx -= nearbyint(dx);
+    dy -= nearbyint(dy);
+    dz -= nearbyint(dz);
+    double cx = dx * m[0] + dy * m[1] + dz * m[2];
+    double cy = dy * m[3] + dz * m[4];
+    double cz = dz * m[5];
+    if (cx * cx + cy * cy + cz * cz < minIADsSquared[atoms.types[i]])
+      return true;
+  }
+  return false;
+}
+
+#ifdef RANDSPG_IAD_KERNEL_DISPATCH
+
+__attribute__((target("avx2")))
+static bool isAnyAtomWithinMinIADAvx2(const iadKernelAtoms& atoms,
+                                      size_t begin, size_t end,
+                                      const double* pos,
+                                      const double* minIADsSquared,
+                                      const double* m)
+{
+  const int roundMode = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  const __m256d px = _mm256_set1_pd(pos[0]);
+  const __m256d py = _mm256_set1_pd(pos[1]);
+  const __m256d pz = _mm256_set1_pd(pos[2]);
+  const __m256d m0 = _mm256_set1_pd(m[0]), m1 = _mm256_set1_pd(m[1]),
+                m2 = _mm256_set1_pd(m[2]), m3 = _mm256_set1_pd(m[3]),
+                m4 = _mm256_set1_pd(m[4]), m5 = _mm256_set1_pd(m[5]);
+  // The unmasked gather leaves its source undefined, which -Wall warns about
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d allLanes = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ);
+
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(atoms.x + i), px);
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(atoms.y + i), py);
+    __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(atoms.z + i), pz);
+    dx = _mm256_sub_pd(dx, _mm256_round_pd(dx, roundMode));
+    dy = _mm256_sub_pd(dy, _mm256_round_pd(dy, roundMode));
+    dz = _mm256_sub_pd(dz, _mm256_round_pd(dz, roundMode));
+
+    __m256d cx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, m0),
+                                             _mm256_mul_pd(dy, m1)),
+                               _mm256_mul_pd(dz, m2));
+    __m256d cy = _mm256_add_pd(_mm256_mul_pd(dy, m3), _mm256_mul_pd(dz, m4));
+    __m256d cz = _mm256_mul_pd(dz, m5);
+    __m256d distSquared = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(cx, cx),
+                                                      _mm256_mul_pd(cy, cy)),
+                                        _mm256_mul_pd(cz, cz));
+
+    __m128i types =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(atoms.types + i));
+    __m256d limits = _mm256_mask_i32gather_pd(zero, minIADsSquared, types,
+                                              allLanes, 8);
+    if (_mm256_movemask_pd(_mm256_cmp_pd(distSquared, limits, _CMP_LT_OQ)))
+      return true;
+  }
+  return isAnyAtomWithinMinIADScalar(atoms, i, end, pos, minIADsSquared, m);
+}
+
+__attribute__((target("avx512f")))
+static bool isAnyAtomWithinMinIADAvx512(const iadKernelAtoms& atoms,
+                                        size_t begin, size_t end,
+                                        const double* pos,
+                                        const double* minIADsSquared,
+                                        const double* m)
+{
+  const int roundMode = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  const __m512d px = _mm512_set1_pd(pos[0]);
+  const __m512d py = _mm512_set1_pd(pos[1]);
+  const __m512d pz = _mm512_set1_pd(pos[2]);
+  const __m512d m0 = _mm512_set1_pd(m[0]), m1 = _mm512_set1_pd(m[1]),
+                m2 = _mm512_set1_pd(m[2]), m3 = _mm512_set1_pd(m[3]),
+                m4 = _mm512_set1_pd(m[4]), m5 = _mm512_set1_pd(m[5]);
+  // The unmasked gather and roundscale leave their sources undefined, which
+  // -Wall warns about
+  const __m512d zero = _mm512_setzero_pd();
+  const __mmask8 allLanes = 0xFF;
+
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(atoms.x + i), px);
+    __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(atoms.y + i), py);
+    __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(atoms.z + i), pz);
+    dx = _mm512_sub_pd(dx, _mm512_mask_roundscale_pd(dx, allLanes, dx,
+                                                         roundMode));
+    dy = _mm512_sub_pd(dy, _mm512_mask_roundscale_pd(dy, allLanes, dy,
+                                                         roundMode));
+    dz = _mm512_sub_pd(dz, _mm512_mask_roundscale_pd(dz, allLanes, dz,
+                                                         roundMode));
+
+    __m512d cx = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, m0),
+                                             _mm512_mul_pd(dy, m1)),
+                               _mm512_mul_pd(dz, m2));
+    __m512d cy = _mm512_add_pd(_mm512_mul_pd(dy, m3), _mm512_mul_pd(dz, m4));
+    __m512d cz = _mm512_mul_pd(dz, m5);
+    __m512d distSquared = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(cx, cx),
+                                                      _mm512_mul_pd(cy, cy)),
+                                        _mm512_mul_pd(cz, cz));
+
+    __m256i types =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(atoms.types + i));
+    __m512d limits = _mm512_mask_i32gather_pd(zero, allLanes, types,
+                                              minIADsSquared, 8);
+    if (_mm512_cmp_pd_mask(distSquared, limits, _CMP_LT_OQ)) return true;
+  }
+  return isAnyAtomWithinMinIADScalar(atoms, i, end, pos, minIADsSquared, m);
+}
+
+#endif // RANDSPG_IAD_KERNEL_DISPATCH
+
+// The kernel for this CPU and its name
+struct selectedIADKernel {
+  iadKernel kernel;
+  const char* name;
+};
+
+static selectedIADKernel selectIADKernel()
+{
+#ifdef RANDSPG_IAD_KERNEL_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {isAnyAtomWithinMinIADAvx512, "avx512"};
+  if (__builtin_cpu_supports("avx2"))
+    return {isAnyAtomWithinMinIADAvx2, "avx2"};
+#endif
+  return {isAnyAtomWithinMinIADScalar, "scalar"};
+}
+
+// The kernel is chosen the first time it is needed
+static const selectedIADKernel& getSelectedIADKernel()
+{
+  static const selectedIADKernel selected = selectIADKernel();
+  return selected;
+}
+
+bool isAnyAtomWithinMinIAD(const iadKernelAtoms& atoms,
+                           size_t begin, size_t end,
+                           const double pos[3],
+                           const double* minIADsSquared,
+                           const double cartConvMat[6])
+{
+  return getSelectedIADKernel().kernel(atoms, begin, end, pos,
+                                       minIADsSquared, cartConvMat);
+}
+
+const char* getIADKernelName()
+{
+  return getSelectedIADKernel().name;
+}
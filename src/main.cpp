@@ -14,20 +14,91 @@
  ***********************************************************************/
 
 // For timings
+#include <atomic>
 #include <chrono>
 // To remove the log file
 #include <cstdio>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <thread>
 
 #include "elemInfo.h"
 #include "fileSystemUtils.h"
+#include "generationPlan.h"
 #include "randSpg.h"
+#include "randSpgContext.h"
 #include "randSpgOptions.h"
 #include "utilityFunctions.h"
 
 using namespace std;
 
+// What one thread did while generating structures
+struct threadStats {
+  size_t numAttempts;
+  size_t numSucceeds;
+  double successTime;
+  double failTime;
+
+  threadStats() : numAttempts(0), numSucceeds(0), successTime(0),
+                  failTime(0) {}
+};
+
+// Generates structures until there are none left. Every thread takes the
+// next structure as soon as it finishes its last one, so no thread sits
+// idle while another is stuck on a difficult spacegroup.
+static void generateStructures(randSpgInput input,
+                               const vector<uint>& spacegroups,
+                               size_t numOfEach, const string& outDir,
+                               const string& comp, bool bufferLog,
+                               atomic<size_t>& nextJob, threadStats& stats)
+{
+  // Only the spacegroup and structure index change between structures, so
+  // every structure of this thread uses the same context. The jobs come in
+  // order of spacegroup, so the plan only has to be compiled again when the
+  // spacegroup changes.
+  RandSpgContext context(input);
+  unique_ptr<GenerationPlan> plan;
+
+  size_t numJobs = spacegroups.size() * numOfEach;
+  for (size_t job = nextJob++; job < numJobs; job = nextJob++) {
+    uint spg = spacegroups[job / numOfEach];
+    size_t j = job % numOfEach;
+    // Compile a plan with the right spacegroup
+    if (!plan || plan->getInput().spg != spg) {
+      input.spg = spg;
+      plan.reset(new GenerationPlan(RandSpg::compile(input, context)));
+    }
+    auto start = chrono::high_resolution_clock::now();
+    string filename = outDir + comp + "_" + to_string(spg) +
+                      "-" + to_string(j + 1);
+
+    // Keep the log of this structure together
+    if (bufferLog) RandSpg::startLogBuffer();
+
+    if (e_verbosity != 'n')
+      RandSpg::appendToLogFile(string("\n**** ") + filename + " ****\n");
+
+    Crystal c = plan->generate(context, j);
+
+    string title = comp + " -- randSpg with spg of: " + to_string(spg);
+
+    // The volume is set to zero if the job failed.
+    if (c.getVolume() != 0) {
+      // Success!
+      c.writePOSCAR(filename, title);
+      stats.successTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+      stats.numSucceeds++;
+    }
+
+    // We failed! Add this to the fail time
+    else stats.failTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+
+    stats.numAttempts++;
+    if (bufferLog) RandSpg::flushLogBuffer();
+  }
+}
+
 int main(int argc, char* argv[])
 {
   if (argc != 2) {
@@ -89,6 +160,10 @@ int main(int argc, char* argv[])
   input.verbosity = options.getVerbosity();
   input.maxAttempts = options.getMaxAttempts();
   input.forceMostGeneralWyckPos = options.forceMostGeneralWyckPos();
+  input.seed = options.getSeed();
+  input.backtrackDepth = options.getBacktrackDepth();
+  input.backtrackRetries = options.getBacktrackRetries();
+  input.placeByDifficulty = options.placeByDifficulty();
 
   // Set up various other options
   vector<uint> spacegroups = options.getSpacegroups();
@@ -109,37 +184,42 @@ int main(int argc, char* argv[])
 
   double successTime = 0, failTime = 0;
 
+  // Use one thread for each hardware thread unless told otherwise, but not
+  // more threads than there are structures
+  size_t numThreads = options.getNumThreads();
+  if (numThreads == 0) numThreads = thread::hardware_concurrency();
+  if (numThreads == 0) numThreads = 1;
+  if (numThreads > numAttempts) numThreads = numAttempts;
+  if (numThreads == 0) numThreads = 1;
+
   auto setup_wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - setup_startTime).count() * 0.000000001;
 
   // Time the loop
   auto start_loopTime = chrono::high_resolution_clock::now();
 
-  for (size_t i = 0; i < spacegroups.size(); i++) {
-    uint spg = spacegroups[i];
-    // Change the input spg to have the right spacegroup
-    input.spg = spg;
-    for (size_t j = 0; j < numOfEach; j++) {
-      auto start = chrono::high_resolution_clock::now();
-      string filename = outDir + comp + "_" + to_string(spg) +
-                        "-" + to_string(j + 1);
-      if (e_verbosity != 'n')
-        RandSpg::appendToLogFile(string("\n**** ") + filename + " ****\n");
-
-      Crystal c = RandSpg::randSpgCrystal(input);
-
-      string title = comp + " -- randSpg with spg of: " + to_string(spg);
-
-      // The volume is set to zero if the job failed.
-      if (c.getVolume() != 0) {
-        // Success!
-        c.writePOSCAR(filename, title);
-        successTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
-        numSucceeds++;
-      }
-
-      // We failed! Add this to the fail time
-      else failTime += chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start).count() * 0.000000001;
+  // Every thread has its own random stream, so the threads do not share
+  // any state while generating. With one thread, we just use this one.
+  atomic<size_t> nextJob(0);
+  vector<threadStats> stats(numThreads);
+  if (numThreads == 1) {
+    generateStructures(input, spacegroups, numOfEach, outDir, comp, false,
+                       nextJob, stats[0]);
+  }
+  else {
+    vector<thread> threads;
+    for (size_t i = 0; i < numThreads; i++) {
+      threads.push_back(thread(generateStructures, input,
+                               cref(spacegroups), numOfEach, cref(outDir),
+                               cref(comp), true, ref(nextJob),
+                               ref(stats[i])));
     }
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+  }
+
+  for (size_t i = 0; i < stats.size(); i++) {
+    numSucceeds += stats[i].numSucceeds;
+    successTime += stats[i].successTime;
+    failTime += stats[i].failTime;
   }
 
   auto loop_wallTime = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start_loopTime).count() * 0.000000001;
@@ -163,7 +243,19 @@ int main(int argc, char* argv[])
            failTime / ((double)(numAttempts - numSucceeds)) : 0)
        << "\n"
        << "Total wall time (in seconds): " << setup_wallTime + loop_wallTime
-       << "\n------------------------------------------------------------ \n";
+       << "\n";
+    if (numThreads > 1) {
+      ss << "Number of threads: " << numThreads << "\n";
+      for (size_t i = 0; i < stats.size(); i++) {
+        double busyTime = stats[i].successTime + stats[i].failTime;
+        ss << "  Thread " << i + 1 << ": " << stats[i].numAttempts
+           << " structures attempted, " << stats[i].numSucceeds
+           << " succeeded, busy for " << busyTime << " seconds ("
+           << ((loop_wallTime != 0) ? 100.0 * busyTime / loop_wallTime : 0)
+           << "% of the structure generation wall time)\n";
+      }
+    }
+    ss << "------------------------------------------------------------ \n";
     RandSpg::appendToLogFile(ss.str());
   }
 }
@@ -0,0 +1,91 @@
+/**********************************************************************
+  minIADTable.cpp - Class for a dense table of the minimum interatomic
+                    distances between every pair of atom types in a
+                    composition
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include "minIADTable.h"
+
+#include "elemInfo.h"
+
+using namespace std;
+
+MinIADTable::MinIADTable(const vector<uint>& atoms, bool usingVdwRadii) :
+  m_typeIndices(),
+  m_numTypes(0),
+  m_minIADs(),
+  m_minIADsSquared(),
+  m_largestMinIAD(0.0)
+{
+  build(atoms, [usingVdwRadii](uint atomicNum1, uint atomicNum2)
+  {
+    // Check to see if we have a custom IAD and use it if we do
+    double minIAD = ElemInfo::customMinIAD(atomicNum1, atomicNum2);
+    if (minIAD != -1.0) return minIAD;
+    return ElemInfo::getRadius(atomicNum1, usingVdwRadii) +
+           ElemInfo::getRadius(atomicNum2, usingVdwRadii);
+  });
+}
+
+MinIADTable::MinIADTable(
+            const vector<uint>& atoms,
+            const vector<double>& radii,
+            const vector<pair<pair<uint, uint>, double>>& customMinIADs) :
+  m_typeIndices(),
+  m_numTypes(0),
+  m_minIADs(),
+  m_minIADsSquared(),
+  m_largestMinIAD(0.0)
+{
+  build(atoms, [&radii, &customMinIADs](uint atomicNum1, uint atomicNum2)
+  {
+    for (size_t i = 0; i < customMinIADs.size(); i++) {
+      const pair<uint, uint>& atomicNums = customMinIADs[i].first;
+      if ((atomicNums.first == atomicNum1 &&
+           atomicNums.second == atomicNum2) ||
+          (atomicNums.first == atomicNum2 &&
+           atomicNums.second == atomicNum1)) {
+        return customMinIADs[i].second;
+      }
+    }
+    double radius1 = (atomicNum1 < radii.size()) ? radii[atomicNum1] : 0.0;
+    double radius2 = (atomicNum2 < radii.size()) ? radii[atomicNum2] : 0.0;
+    return radius1 + radius2;
+  });
+}
+
+void MinIADTable::build(const vector<uint>& atoms,
+                        const function<double(uint, uint)>& getMinIAD)
+{
+  // Assign type indices in order of appearance
+  vector<uint> types;
+  for (size_t i = 0; i < atoms.size(); i++) {
+    if (atoms[i] >= m_typeIndices.size()) m_typeIndices.resize(atoms[i] + 1, -1);
+    if (m_typeIndices[atoms[i]] != -1) continue;
+    m_typeIndices[atoms[i]] = types.size();
+    types.push_back(atoms[i]);
+  }
+
+  m_numTypes = types.size();
+  m_minIADs.resize(m_numTypes * m_numTypes);
+  m_minIADsSquared.resize(m_numTypes * m_numTypes);
+  for (size_t i = 0; i < m_numTypes; i++) {
+    for (size_t j = 0; j < m_numTypes; j++) {
+      double minIAD = getMinIAD(types[i], types[j]);
+      m_minIADs[i * m_numTypes + j] = minIAD;
+      m_minIADsSquared[i * m_numTypes + j] = minIAD * minIAD;
+      if (minIAD > m_largestMinIAD) m_largestMinIAD = minIAD;
+    }
+  }
+}
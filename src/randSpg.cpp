@@ -13,10 +13,11 @@
 
  ***********************************************************************/
 
-#include "elemInfo.h"
+#include "generationPlan.h"
 
 #include "randSpg.h"
 #include "randSpgCombinatorics.h"
+#include "randSpgContext.h"
 #include "wyckoffDatabase.h"
 #include "fillCellDatabase.h"
 #include "utilityFunctions.h"
@@ -27,10 +28,17 @@
 // For FunctionTracker
 #include "functionTracker.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <fstream>
 #include <tuple>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 // Define these for debug output
 //#define RANDSPG_DEBUG
@@ -45,34 +53,101 @@ using namespace std;
 string e_logfilename = "randSpg.log";
 char e_verbosity = 'r';
 
-// Check if all the multiplicities of a spacegroup are even
-static inline bool spgMultsAreAllEven(uint spg)
+// The largest number of atoms of one type that the tables in
+// spgNumAtomsInfo cover
+static const size_t maxTabulatedNumAtoms = 511;
+
+// Information about the multiplicities of a spacegroup that can rule a
+// composition in or out without searching through the Wyckoff positions
+struct spgNumAtomsInfo {
+  // The greatest common divisor of the multiplicities. The number of atoms
+  // of every type must be a multiple of it.
+  uint gcd;
+  // Bit n is set if n atoms of one type fit in the spacegroup
+  bitset<maxTabulatedNumAtoms + 1> possible;
+  // Bit n is set if n atoms of one type fit in the non-unique positions.
+  // Atom types that only use those never get in each other's way.
+  bitset<maxTabulatedNumAtoms + 1> possibleWithoutUnique;
+};
+
+static spgNumAtomsInfo createSpgNumAtomsInfo(uint spg)
 {
-  START_FT;
-  wyckoffPositions wyckVector = RandSpg::getWyckoffPositions(spg);
-  // An error message should already be printed if this returns false
-  if (wyckVector.size() == 0) return false;
+  spgNumAtomsInfo info;
+  info.gcd = 0;
+  info.possible.set(0);
+  info.possibleWithoutUnique.set(0);
+
+  const vector<similarWyckPositions>& similarWyckPos =
+    RandSpgCombinatorics::getSimilarWyckPositions(spg);
+  for (size_t i = 0; i < similarWyckPos.size(); i++) {
+    uint mult = RandSpg::getMultiplicity(similarWyckPos[i][0]);
+    info.gcd = getGcd(info.gcd, mult);
+    if (mult == 0 || mult > maxTabulatedNumAtoms) continue;
+
+    if (RandSpg::containsUniquePosition(similarWyckPos[i][0])) {
+      // Each of the unique positions may be used once
+      for (size_t j = 0; j < similarWyckPos[i].size(); j++)
+        info.possible |= (info.possible << mult);
+    }
+    else {
+      // The others may be used any number of times
+      for (size_t n = mult; n <= maxTabulatedNumAtoms; n += mult) {
+        info.possible |= (info.possible << mult);
+        info.possibleWithoutUnique |= (info.possibleWithoutUnique << mult);
+      }
+    }
+  }
+  return info;
+}
+
+static const spgNumAtomsInfo& getSpgNumAtomsInfo(uint spg)
+{
+  // This is only created once (and the initialization is thread-safe)
+  static const vector<spgNumAtomsInfo> allInfo = []()
+  {
+    vector<spgNumAtomsInfo> ret(231);
+    for (uint i = 1; i <= 230; i++) ret[i] = createSpgNumAtomsInfo(i);
+    return ret;
+  }();
+  return allInfo[spg];
+}
+
+// Tries to decide if a spacegroup is possible with the tables alone.
+// Returns 1 if it is, 0 if it is not, and -1 if we have to search.
+static int isSpgPossibleFromTables(uint spg,
+                                   const vector<numAndType>& numOfEachType)
+{
+  if (numOfEachType.empty()) return 0;
 
-  for (size_t i = 0; i < wyckVector.size(); i++) {
-    if (numIsOdd(RandSpg::getMultiplicity(wyckVector[i]))) return false;
+  const spgNumAtomsInfo& info = getSpgNumAtomsInfo(spg);
+  bool allWithoutUnique = true;
+  for (size_t i = 0; i < numOfEachType.size(); i++) {
+    uint numAtoms = numOfEachType[i].first;
+    if (info.gcd == 0 || numAtoms % info.gcd != 0) return 0;
+    if (numAtoms > maxTabulatedNumAtoms) {
+      allWithoutUnique = false;
+      continue;
+    }
+    if (!info.possible[numAtoms]) return 0;
+    if (!info.possibleWithoutUnique[numAtoms]) allWithoutUnique = false;
   }
-  return true;
+  return allWithoutUnique ? 1 : -1;
 }
 
 vector<numAndType> RandSpg::getNumOfEachType(const vector<uint>& atoms)
 {
   START_FT;
-  vector<uint> atomsAlreadyCounted;
+  // The types are counted in the order they first appear
   vector<numAndType> numOfEachType;
+  unordered_map<uint, size_t> typeIndices;
   for (size_t i = 0; i < atoms.size(); i++) {
-    size_t size = 0;
-    // If we already counted this one, just continue
-    if (std::find(atomsAlreadyCounted.begin(), atomsAlreadyCounted.end(),
-                  atoms[i]) != atomsAlreadyCounted.end()) continue;
-    for (size_t j = 0; j < atoms.size(); j++)
-      if (atoms[j] == atoms[i]) size++;
-    numOfEachType.push_back(make_pair(size, atoms[i]));
-    atomsAlreadyCounted.push_back(atoms[i]);
+    unordered_map<uint, size_t>::const_iterator it = typeIndices.find(atoms[i]);
+    if (it != typeIndices.end()) {
+      numOfEachType[it->second].first++;
+      continue;
+    }
+    typeIndices[atoms[i]] = numOfEachType.size();
+    numOfEachType.push_back(make_pair(1, atoms[i]));
   }
   // Sort from largest to smallest
   sort(numOfEachType.begin(), numOfEachType.end(), greaterThan);
@@ -132,16 +207,26 @@ bool getNumberInFirstTerm(const string& s, double& result, size_t& len)
 // This might be a little bit too long to be inline...
 double RandSpg::interpretComponent(const string& component,
                                    double x, double y, double z)
+{
+  double result = 0;
+  if (!interpretComponent(component, x, y, z, result))
+    return (component.size() == 0) ? -1 : 0;
+  return result;
+}
+
+bool RandSpg::interpretComponent(const string& component,
+                                 double x, double y, double z,
+                                 double& result)
 {
   START_FT;
 
   if (component.size() == 0) {
     cout << "Error in RandSpg::interpretComponent(): component is empty!\n";
-    return -1;
+    return false;
   }
 
-  int i = 0;
-  double result = 0;
+  size_t i = 0;
+  result = 0;
   while (i < component.size()) {
     // We assume we are adding unless told otherwise
     if (component[i] == '+') i++;
@@ -150,7 +235,7 @@ double RandSpg::interpretComponent(const string& component,
     size_t len = 0;
     if (!getNumberInFirstTerm(component.substr(i), numInFront, len)) {
       cout << "Error in " << __FUNCTION__ << " getting number in term.\n";
-      return 0;
+      return false;
     }
 
     // Shift i so that it is past the length of the number
@@ -182,7 +267,73 @@ double RandSpg::interpretComponent(const string& component,
     }
   }
 
-  return result;
+  return true;
+}
+
+bool RandSpg::compileCoords(const string& coords, affineTransform& result)
+{
+  vector<string> components = split(coords, ',');
+  if (components.size() != 3) {
+    cout << "Error in " << __FUNCTION__ << ": invalid coordinates: "
+         << coords << "\n";
+    return false;
+  }
+
+  for (size_t i = 0; i < 3; ++i) {
+    // Every component is linear, so evaluating it at the origin gives the
+    // translation, and evaluating it at the unit vectors gives the
+    // coefficients
+    double t, cx, cy, cz;
+    if (!interpretComponent(components[i], 0.0, 0.0, 0.0, t) ||
+        !interpretComponent(components[i], 1.0, 0.0, 0.0, cx) ||
+        !interpretComponent(components[i], 0.0, 1.0, 0.0, cy) ||
+        !interpretComponent(components[i], 0.0, 0.0, 1.0, cz)) {
+      cout << "Error in " << __FUNCTION__ << ": failed to read component '"
+           << components[i] << "' of " << coords << "\n";
+      return false;
+    }
+    result.trans[i] = t;
+    result.rot[i][0] = cx - t;
+    result.rot[i][1] = cy - t;
+    result.rot[i][2] = cz - t;
+  }
+  return true;
+}
+
+// The compiled coordinates of every Wyckoff position in the database. The
+// indices match those of wyckoffPositionsDatabase.
+static vector<vector<affineTransform>> compileWyckoffDatabase()
+{
+  vector<vector<affineTransform>> ret(wyckoffPositionsDatabase.size());
+  for (size_t spg = 1; spg < wyckoffPositionsDatabase.size(); ++spg) {
+    const wyckoffPositions& positions = wyckoffPositionsDatabase[spg];
+    ret[spg].resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+      if (!RandSpg::compileCoords(RandSpg::getWyckCoords(positions[i]),
+                                  ret[spg][i])) {
+        cout << "Error: failed to compile Wyckoff position '"
+             << RandSpg::getWyckLet(positions[i]) << "' of spg " << spg
+             << "\n";
+      }
+    }
+  }
+  return ret;
+}
+
+const affineTransform* RandSpg::getCompiledWyckCoords(uint spg, char wyckLet)
+{
+  // This is only compiled once (and the initialization is thread-safe)
+  static const vector<vector<affineTransform>> compiledDatabase =
+    compileWyckoffDatabase();
+
+  const wyckoffPositions& positions = getWyckoffPositions(spg);
+  for (size_t i = 0; i < positions.size(); ++i) {
+    if (getWyckLet(positions[i]) == wyckLet)
+      return &compiledDatabase[spg][i];
+  }
+  cout << "Error in " << __FUNCTION__ << ": wyckLet '" << wyckLet
+       << "' not found in spg '" << spg  << "'!\n";
+  return nullptr;
 }
 
 const wyckoffPositions& RandSpg::getWyckoffPositions(uint spg)
@@ -197,15 +348,38 @@ const wyckoffPositions& RandSpg::getWyckoffPositions(uint spg)
   return wyckoffPositionsDatabase[spg];
 }
 
-wyckPos RandSpg::getWyckPosFromWyckLet(uint spg, char wyckLet)
+const wyckPos& RandSpg::getWyckPos(wyckHandle h)
+{
+  static const wyckPos invalidWyckPos;
+  uint spg = getWyckHandleSpg(h);
+  uint index = getWyckHandleIndex(h);
+  if (spg < 1 || spg > 230 ||
+      index >= wyckoffPositionsDatabase[spg].size()) {
+    cout << "Error in " << __FUNCTION__ << ": invalid handle '" << h
+         << "'!\n";
+    return invalidWyckPos;
+  }
+  return wyckoffPositionsDatabase[spg][index];
+}
+
+const wyckPos& RandSpg::getWyckPosFromWyckLet(uint spg, char wyckLet)
+{
+  static const wyckPos invalidWyckPos;
+  wyckHandle h = getWyckHandleFromWyckLet(spg, wyckLet);
+  if (getWyckHandleIndex(h) >= getWyckoffPositions(spg).size())
+    return invalidWyckPos;
+  return getWyckPos(h);
+}
+
+wyckHandle RandSpg::getWyckHandleFromWyckLet(uint spg, char wyckLet)
 {
   const wyckoffPositions& wyckpos = getWyckoffPositions(spg);
   for (size_t i = 0; i < wyckpos.size(); i++) {
-    if (getWyckLet(wyckpos[i]) == wyckLet) return wyckpos[i];
+    if (getWyckLet(wyckpos[i]) == wyckLet) return getWyckHandle(spg, i);
   }
   cout << "Error in " << __FUNCTION__ << ": wyckLet '" << wyckLet
        << "' not found in spg '" << spg  << "'!\n";
-  return wyckPos();
+  return getWyckHandle(spg, 0xFFFF);
 }
 
 const fillCellInfo& RandSpg::getFillCellInfo(uint spg)
@@ -236,20 +410,51 @@ vector<string> RandSpg::getVectorOfFillPositions(uint spg)
   return ret;
 }
 
-inline unsigned char numVariablesInCoord(const string& coord)
+// The symmetry operations of every spacegroup. The indices match those of
+// fillCellVector.
+static vector<vector<affineTransform>> compileSymmetryOperations()
 {
-  bool x = false, y = false, z = false;
-  for (size_t i = 0; i < coord.size(); ++i) {
-    if (coord[i] == 'x')
-      x = true;
-    else if (coord[i] == 'y')
-      y = true;
-    else if (coord[i] == 'z')
-      z = true;
-    if (x && y && z)
-      break;
+  vector<vector<affineTransform>> ret(fillCellVector.size());
+  for (size_t spg = 1; spg < fillCellVector.size(); ++spg) {
+    vector<string> dupVec = RandSpg::getVectorOfDuplications(spg);
+    vector<string> fpVec = RandSpg::getVectorOfFillPositions(spg);
+
+    vector<affineTransform> fillPositions(fpVec.size());
+    for (size_t k = 0; k < fpVec.size(); ++k) {
+      if (!RandSpg::compileCoords(fpVec[k], fillPositions[k])) {
+        cout << "Error: failed to compile fill position '" << fpVec[k]
+             << "' of spg " << spg << "\n";
+      }
+    }
+
+    ret[spg].reserve(dupVec.size() * fpVec.size());
+    for (size_t j = 0; j < dupVec.size(); ++j) {
+      // These are all just numbers, so we can just convert them
+      vector<string> dupComponents = split(dupVec[j], ',');
+      double dup[3] = {stof(dupComponents[0]), stof(dupComponents[1]),
+                       stof(dupComponents[2])};
+      for (size_t k = 0; k < fillPositions.size(); ++k) {
+        affineTransform op = fillPositions[k];
+        for (size_t i = 0; i < 3; ++i) op.trans[i] += dup[i];
+        ret[spg].push_back(op);
+      }
+    }
   }
-  return x + y + z;
+  return ret;
+}
+
+const vector<affineTransform>& RandSpg::getSymmetryOperations(uint spg)
+{
+  // This is only compiled once (and the initialization is thread-safe)
+  static const vector<vector<affineTransform>> compiledOperations =
+    compileSymmetryOperations();
+
+  if (spg < 1 || spg > 230) {
+    cout << "Error. getSymmetryOperations() was called for a spacegroup "
+         << "that does not exist! Given spacegroup is " << spg << endl;
+    return compiledOperations[0];
+  }
+  return compiledOperations[spg];
 }
 
 bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
@@ -262,7 +467,13 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
   cout << "Attempting to add an atom of atomicNum " << atomicNum
        << " at position " << getWyckCoords(position) << "\n";
 #endif
-  string wyckCoords = getWyckCoords(position);
+  const affineTransform* wyckCoords =
+    getCompiledWyckCoords(spg, getWyckLet(position));
+  if (!wyckCoords) {
+    cout << "addWyckoffAtomRandomly() failed due to the Wyckoff position "
+         << "not being found!\n";
+    return false;
+  }
 
   // If this contains a unique position, we only need to try once
   // Otherwise, we'd be repeatedly trying the same thing...
@@ -277,7 +488,7 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
   // maxAttempts = numVariables * 500
   else {
     // This should never be zero if containsUniquePosition() is false
-    unsigned char numVariables = numVariablesInCoord(wyckCoords);
+    unsigned char numVariables = wyckCoords->numVariables();
     maxAttempts = numVariables * 500;
     // Just a safety check - should not happen
     if (maxAttempts == 0)
@@ -293,32 +504,15 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
     double y = getRandDouble(0,1);
     double z = getRandDouble(0,1);
 
-    vector<string> components = split(wyckCoords, ',');
-
-    // Interpret the three components of the Wyckoff position coordinates...
-    double newX = interpretComponent(components[0], x, y, z);
-    double newY = interpretComponent(components[1], x, y, z);
-    double newZ = interpretComponent(components[2], x, y, z);
-
-    // interpretComponenet() returns -1 if it failed to read the component
-    if (newX == -1 || newY == -1 || newZ == -1) {
-      cout << "addWyckoffAtomRandomly() failed due to a component not being "
-           << "read successfully!\n";
-      return false;
-    }
+    // Apply the Wyckoff position coordinates...
+    double newX, newY, newZ;
+    wyckCoords->apply(x, y, z, newX, newY, newZ);
 
+    // Add the atom and fill the cell using it, but only if all of the
+    // interatomic distances are okay. If they are not, the crystal is left
+    // untouched and we try again.
     atomStruct newAtom(atomicNum, newX, newY, newZ);
-    crystal.addAtom(newAtom);
-
-    // Check the interatomic distances
-    if (crystal.areIADsOkay(newAtom)) {
-      // Now try to fill the cell using this new atom
-      if (crystal.fillCellWithAtom(spg, newAtom)) success = true;
-    }
-    if (!success) {
-      // Remove this atom and try again
-      crystal.removeAtom(newAtom);
-    }
+    if (crystal.addAtomAndOrbitIfIADsAreOkay(spg, newAtom)) success = true;
 
     i++;
   } while (i < maxAttempts && !success);
@@ -334,298 +528,96 @@ bool RandSpg::addWyckoffAtomRandomly(Crystal& crystal, const wyckPos& position,
   return true;
 }
 
-// This just converts the second element in the pair (the 'char') to a wyckPos
-static vector<pair<uint, wyckPos>>
-getModifiedForcedWyckVector(const vector<pair<uint, char>>& v, uint spg)
+Crystal RandSpg::randSpgCrystal(const randSpgInput& input)
 {
-  vector<pair<uint, wyckPos>> ret;
-  for (size_t i = 0; i < v.size(); i++)
-    ret.push_back(make_pair(v[i].first,
-                          RandSpg::getWyckPosFromWyckLet(spg, v[i].second)));
-  return ret;
+  // The context starts with the current stream of this thread. Continue
+  // from where it stopped so that unseeded calls keep drawing new numbers.
+  RandSpgContext context(input);
+  Crystal crystal = randSpgCrystal(input, context);
+  setRandStream(context.getRandStream());
+  return crystal;
 }
 
-// Convenience function for counting the number of times a forced Wyck
-// assignment is used and storing the information in a vector of tuples
-static vector<tuple<uint, char, uint>>
-getForcedWyckAssignmentsAndNumber(const vector<pair<uint, char>>& forcedWyckAssignments)
-{
-  vector<pair<uint, char>> alreadyUsedForcedWyckAssignments;
-  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
-  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber;
-  for (size_t i = 0; i < forcedWyckAssignments.size(); i++) {
-    // Check to see if we've already looked at this assignment
-    bool alreadyUsed = false;
-    for (size_t j = 0; j < alreadyUsedForcedWyckAssignments.size(); j++) {
-      if (forcedWyckAssignments[i] ==
-          alreadyUsedForcedWyckAssignments[j]) {
-        alreadyUsed = true;
-        break;
-      }
-    }
-    // If we've already looked at it, just continue
-    if (alreadyUsed) continue;
-    // Now count how many times we use this
-    uint numTimesUsed = 1;
-    for (size_t j = i + 1; j < forcedWyckAssignments.size(); j++) {
-      if (forcedWyckAssignments[i] == forcedWyckAssignments[j])
-        numTimesUsed++;
-    }
-    alreadyUsedForcedWyckAssignments.push_back(forcedWyckAssignments[i]);
-    forcedWyckAssignmentsAndNumber.push_back(make_tuple(
-      forcedWyckAssignments[i].first,
-      forcedWyckAssignments[i].second,
-      numTimesUsed));
-  }
-  return forcedWyckAssignmentsAndNumber;
-}
-
-Crystal createValidCrystal(uint spg, const latticeStruct& latticeMins,
-                           const latticeStruct& latticeMaxes,
-                           double minVolume, double maxVolume)
-{
-  Crystal ret;
-  // If we fail to do this 1000 times, return an empty crystal
-  size_t maxAttempts = 1000;
-  size_t numAttempts = 0;
-  bool validCrystal = false;
-  while (maxAttempts > numAttempts && !validCrystal) {
-    numAttempts++;
-
-    // First let's get a lattice...
-    latticeStruct st = RandSpg::generateLatticeForSpg(spg, latticeMins, latticeMaxes);
-    Crystal crystal(st);
-
-    // Make sure it's a valid lattice
-    if (st.a == 0 || st.b == 0 || st.c == 0 ||
-        st.alpha == 0 || st.beta == 0 || st.gamma == 0) {
-      cout << "Error in RandSpg::createValidCrystal(): an invalid lattice was "
-           << "generated.\n";
-      return Crystal();
-    }
-
-    // Rescale the volume of the crystal if necessary
-    if (maxVolume != -1 && crystal.getVolume() > maxVolume)
-      // Pick a random number between the min and max volume and rescale to it
-      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
-    else if (minVolume != -1 && crystal.getVolume() < minVolume)
-      crystal.rescaleVolume(getRandDouble(minVolume, maxVolume));
-
-    // After rescaling, check again to make sure a, b, and c are within
-    // the correct limits
-    st = crystal.getLattice();
-    if (latticeMins.a <= st.a && st.a <= latticeMaxes.a &&
-        latticeMins.b <= st.b && st.b <= latticeMaxes.b &&
-        latticeMins.c <= st.c && st.c <= latticeMaxes.c) {
-      ret = crystal;
-      validCrystal = true;
-    }
-    // If the crystal is not valid, we'll try again
-  }
+Crystal RandSpg::randSpgCrystal(const randSpgInput& input,
+                                RandSpgContext& context)
+{
+  START_FT;
+  return compile(input, context).generate(context, input.structureIndex);
+}
 
-  // If we get to the point without a valid crystal,
-  // we exceeded the max attempts
-  if (!validCrystal) {
-    cerr << "After " << maxAttempts
-         << " attempts, a valid crystal could not be made for "
-         << "spg '" << spg << "' and the given latticeMins, latticeMaxes, "
-         << "minVolume of '" << minVolume << "' and maxVolume of '"
-         << maxVolume << "'\n";
-    cerr << "Aborting this crystal.\n";
-    return Crystal();
-  }
-  return ret;
+GenerationPlan RandSpg::compile(const randSpgInput& input)
+{
+  RandSpgContext context(input);
+  return compile(input, context);
 }
 
-Crystal RandSpg::randSpgCrystal(const randSpgInput& input)
+GenerationPlan RandSpg::compile(const randSpgInput& input,
+                                const RandSpgContext& context)
 {
   START_FT;
+  return GenerationPlan(input, context);
+}
 
-  // Convenience: so we don't have to say 'input.<option>' for every call
-  uint spg                                                      = input.spg;
-  const vector<uint>& atoms                                     = input.atoms;
-  const latticeStruct& latticeMins                              = input.latticeMins;
-  const latticeStruct& latticeMaxes                             = input.latticeMaxes;
-  double IADScalingFactor                                       = input.IADScalingFactor;
-  double minRadius                                              = input.minRadius;
-  const std::vector<std::pair<uint, double>>& manualAtomicRadii = input.manualAtomicRadii;
-  const std::vector<std::pair<std::pair<uint, uint>, double>>& customMinIADs = input.customMinIADs;
-  double minVolume                                              = input.minVolume;
-  double maxVolume                                              = input.maxVolume;
-  vector<pair<uint, char>> forcedWyckAssignments                = input.forcedWyckAssignments;
-  char verbosity                                                = input.verbosity;
-  int numAttempts                                               = input.maxAttempts;
-  bool forceMostGeneralWyckPos                                  = input.forceMostGeneralWyckPos;
-
-  // Change the atomic radii as necessary
-  ElemInfo::applyScalingFactor(IADScalingFactor);
-
-  // Set the min radius
-  ElemInfo::setMinRadius(minRadius);
-
-  // Set some explicit radii
-  for (size_t i = 0; i < manualAtomicRadii.size(); i++) {
-    uint atomicNum = manualAtomicRadii[i].first;
-    double rad = manualAtomicRadii[i].second;
-    ElemInfo::setRadius(atomicNum, rad);
-  }
-
-  // Set the custom minIADs
-  // Clear any previous runs first
-  ElemInfo::clearCustomMinIADs();
-  for (size_t i = 0; i < customMinIADs.size(); ++i) {
-    uint atomicNum1 = customMinIADs[i].first.first;
-    uint atomicNum2 = customMinIADs[i].first.second;
-    double minIAD = customMinIADs[i].second;
-    ElemInfo::appendCustomMinIAD(atomicNum1, atomicNum2, minIAD);
-  }
-
-  systemPossibilities possibilities = RandSpgCombinatorics::getSystemPossibilities(spg, atoms);
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition\n";
-    return Crystal();
-  }
-
-  // force the most general Wyckoff position to be used at least once?
-  if (forceMostGeneralWyckPos)
-    possibilities = RandSpgCombinatorics::removePossibilitiesWithoutGeneralWyckPos(possibilities, spg);
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition.\n";
-    cout << "It can be generated if option 'forceMostGeneralWyckPos' is "
-         << "turned off, but the correct spacegroup will not be guaranteed.\n";
-    return Crystal();
-  }
-
-  // The tuple is as follows: <atomicNum, wyckLet, numTimesUsed>
-  vector<tuple<uint, char, uint>> forcedWyckAssignmentsAndNumber = getForcedWyckAssignmentsAndNumber(forcedWyckAssignments);
-
-  for (size_t i = 0; i < forcedWyckAssignmentsAndNumber.size(); i++) {
-    possibilities =
-      RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(possibilities,
-                  get<1>(forcedWyckAssignmentsAndNumber[i]),
-                  get<2>(forcedWyckAssignmentsAndNumber[i]),
-                  get<0>(forcedWyckAssignmentsAndNumber[i]));
-  }
-
-  if (possibilities.size() == 0) {
-    cout << "Error in RandSpg::" << __FUNCTION__ << "(): this spg '" << spg
-         << "' cannot be generated with this composition due to the forced "
-         << "Wyckoff position constraints.\nPlease change them or remove them "
-         << "if you wish to generate the space group.\n";
-    return Crystal();
-  }
-
-  //RandSpgCombinatorics::printSystemPossibilities(possibilities);
-  // If we desire verbose output, print the system possibility to the log file
-  if (verbosity == 'v')
-    appendToLogFile(RandSpgCombinatorics::getVerbosePossibilitiesString(possibilities));
-
-  // Create a modified forced wyck vector for later...
-  vector<pair<uint, wyckPos>> modifiedForcedWyckVector = getModifiedForcedWyckVector(forcedWyckAssignments, spg);
-
-  // Begin the attempt loop!
-  for (size_t i = 0; i < numAttempts; i++) {
-
-    Crystal crystal = createValidCrystal(spg, latticeMins, latticeMaxes,
-                                         minVolume, maxVolume);
-
-    // Now, let's assign some atoms!
-    atomAssignments assignments = RandSpgCombinatorics::getRandomAtomAssignments(possibilities, modifiedForcedWyckVector);
-
-    //printAtomAssignments(assignments);
-    // If we desire any output, print the atom assignments to the log file
-    if (verbosity == 'r' || verbosity == 'v')
-      appendToLogFile(getAtomAssignmentsString(assignments));
-
-    if (assignments.size() == 0) {
-      cout << "Error in RandSpg::randSpgXtal(): atoms were not successfully"
-           << " assigned positions in assignAtomsToWyckPos()\n";
-      continue;
-    }
-
-#ifdef RANDSPG_DEBUG
-    cout << "\natomAssignments are the following (atomicNum, wyckLet, wyckPos):"
-         << "\n";
-    for (size_t j = 0; j < assignments.size(); j++)
-      cout << "  " << assignments[j].second << ", "
-           << getWyckLet(assignments[j].first)
-           << ", " << getWyckCoords(assignments[j].first) << "\n";
-    cout << "\n";
-#endif
+bool RandSpg::isSpgPossible(uint spg, const vector<uint>& atoms)
+{
+  START_FT;
 
-    bool assignmentsSuccessful = true;
-    for (size_t j = 0; j < assignments.size(); j++) {
-      const wyckPos& pos = assignments[j].first;
-      uint atomicNum = assignments[j].second;
-      if (!addWyckoffAtomRandomly(crystal, pos, atomicNum, spg)) {
-        assignmentsSuccessful = false;
-        break;
-      }
-    }
+  if (spg < 1 || spg > 230) return false;
 
-    // If we succeeded, and the number of atoms match, return the crystal!
-    // There are rare cases where an atom may be placed on top of another
-    // one and the essentially get merged into one. We check to make sure the
-    // sizes of the atomic numbers match for this reason. We shouldn't have to
-    // worry about types.
-    if (assignmentsSuccessful &&
-        atoms.size() == crystal.getVectorOfAtomicNums().size()) {
-      if (verbosity != 'n') appendToLogFile("*** Success! ***\n");
-      return crystal;
-    }
-    else {
-      if (verbosity == 'r' || verbosity == 'v') {
-        stringstream ss;
-        ss << "Failed to add atoms to satisfy MinIAD.\nObtaining new atom "
-           << "assignments and trying again. Failure count: " << i + 1 << "\n\n";
-        appendToLogFile(ss.str());
-      }
-      continue;
-    }
-  }
+  // Most spacegroups can be ruled in or out with the tables of the numbers
+  // of atoms that fit in them
+  vector<numAndType> numOfEachType = getNumOfEachType(atoms);
+  int result = isSpgPossibleFromTables(spg, numOfEachType);
+  if (result != -1) return result == 1;
 
-  // If we made it here, we failed to generate the crystal
-  stringstream errMsg;
-  errMsg << "After " << numAttempts << " attempts: failed to generate "
-         << "a crystal of spg " << spg << ".\n";
-  if (verbosity != 'n') appendToLogFile(errMsg.str());
-  cerr << errMsg.str();
-  return Crystal();
+  // If that failed, we must search for a way to assign the atoms
+  return RandSpgCombinatorics::systemPossibilityExists(spg, numOfEachType);
 }
 
-bool RandSpg::isSpgPossible(uint spg, const vector<uint>& atoms)
+bitset<230> RandSpg::getPossibleSpacegroups(const vector<uint>& atoms,
+                                            uint numThreads)
 {
   START_FT;
+  bitset<230> ret;
 
-  if (spg < 1 || spg > 230) return false;
-
-  // Add in a test here to shorten the time checking if a spg is possible
-  // If a spacegroup contains all even number multiplicities (many do),
-  // and there is an atom with an odd amount, then that spacegroup is not
-  // not possible
   vector<numAndType> numOfEachType = getNumOfEachType(atoms);
-  bool containsOdd = false;
-  for (size_t i = 0; i < numOfEachType.size(); i++) {
-    if (numIsOdd(numOfEachType[i].first)) {
-      containsOdd = true;
-      break;
-    }
+
+  // Decide as many as we can with the tables
+  vector<uint> spgsToSearch;
+  for (uint spg = 1; spg <= 230; spg++) {
+    int result = isSpgPossibleFromTables(spg, numOfEachType);
+    if (result == 1) ret.set(spg - 1);
+    else if (result == -1) spgsToSearch.push_back(spg);
   }
 
-  if (containsOdd && spgMultsAreAllEven(spg)) return false;
+  if (spgsToSearch.empty()) return ret;
+
+  // Search for the rest in parallel. Each thread takes the next spacegroup
+  // that has not been taken yet.
+  vector<char> found(spgsToSearch.size(), 0);
+  atomic<size_t> nextIndex(0);
+  auto search = [&]()
+  {
+    size_t i;
+    while ((i = nextIndex++) < spgsToSearch.size()) {
+      found[i] = RandSpgCombinatorics::systemPossibilityExists(
+                   spgsToSearch[i], numOfEachType);
+    }
+  };
+
+  if (numThreads == 0) numThreads = thread::hardware_concurrency();
+  if (numThreads > spgsToSearch.size()) numThreads = spgsToSearch.size();
 
-  // If the test failed, we must just try to assign atoms and see if it works
-  // The third boolean parameter is telling it to find only one combination
-  // This speeds it up significantly
-  if (RandSpgCombinatorics::getSystemPossibilities(spg, atoms,
-                                                   true, false).size() == 0)
-    return false;
+  // This thread searches too
+  vector<thread> threads;
+  for (uint i = 1; i < numThreads; i++) threads.push_back(thread(search));
+  search();
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
 
-  return true;
+  for (size_t i = 0; i < spgsToSearch.size(); i++) {
+    if (found[i]) ret.set(spgsToSearch[i] - 1);
+  }
+  return ret;
 }
 
 template <typename T>
@@ -883,6 +875,171 @@ latticeStruct RandSpg::generateLatticeForSpg(uint spg,
   return st;
 }
 
+// The volume of a cell with these angles and unit lengths
+static double getUnitVolume(const latticeStruct& st)
+{
+  const double alpha = deg2rad(st.alpha);
+  const double beta = deg2rad(st.beta);
+  const double gamma = deg2rad(st.gamma);
+  double squared = 1.0 -
+                   pow(cos(alpha), 2.0) -
+                   pow(cos(beta), 2.0) -
+                   pow(cos(gamma), 2.0) +
+                   2.0 * cos(alpha) * cos(beta) * cos(gamma);
+  return (squared > 0.0) ? sqrt(squared) : 0.0;
+}
+
+// A lattice length that is free to vary: its bounds and how many of a, b,
+// and c are equal to it
+struct freeLength {
+  double min;
+  double max;
+  int power;
+};
+
+static inline double power(double x, int p)
+{
+  return (p == 1) ? x : ((p == 2) ? x * x : x * x * x);
+}
+
+static inline double root(double x, int p)
+{
+  return (p == 1) ? x : ((p == 2) ? sqrt(x) : cbrt(x));
+}
+
+latticeStruct RandSpg::generateLatticeForSpg(uint spg,
+                                             const latticeStruct& mins,
+                                             const latticeStruct& maxes,
+                                             double minVolume,
+                                             double maxVolume)
+{
+  START_FT;
+
+  // Without a volume constraint, the lengths are independent
+  if (minVolume == -1 && maxVolume == -1)
+    return generateLatticeForSpg(spg, mins, maxes);
+
+  // The lengths that may vary independently. The call to
+  // generateLatticeForSpg() below checks that the equal ones can be equal
+  // and that the angles are allowed.
+  freeLength lengths[3];
+  size_t numLengths;
+  if (spg <= 74) {
+    lengths[0] = {mins.a, maxes.a, 1};
+    lengths[1] = {mins.b, maxes.b, 1};
+    lengths[2] = {mins.c, maxes.c, 1};
+    numLengths = 3;
+  }
+  else if (spg <= 194) {
+    lengths[0] = {max(mins.a, mins.b), min(maxes.a, maxes.b), 2};
+    lengths[1] = {mins.c, maxes.c, 1};
+    numLengths = 2;
+  }
+  else {
+    lengths[0] = {getLargest<double>(mins.a, mins.b, mins.c),
+                  getSmallest<double>(maxes.a, maxes.b, maxes.c), 3};
+    numLengths = 1;
+  }
+
+  // The range of the product of the lengths (a * b * c)
+  double minProduct = 1.0, maxProduct = 1.0;
+  for (size_t i = 0; i < numLengths; i++) {
+    minProduct *= power(lengths[i].min, lengths[i].power);
+    maxProduct *= power(lengths[i].max, lengths[i].power);
+  }
+
+  // The angles are drawn the same way as without a volume constraint. This
+  // also checks that the spacegroup, the angles, and the lengths that must
+  // be equal are possible, so it is done before the volume is checked.
+  latticeStruct st = generateLatticeForSpg(spg, mins, maxes);
+  if (st.a == 0 || st.b == 0 || st.c == 0 ||
+      st.alpha == 0 || st.beta == 0 || st.gamma == 0) {
+    return latticeStruct();
+  }
+
+  // No angles give a unit volume above 1, so this cannot be met at all
+  if (minVolume != -1 && minVolume > maxProduct) {
+    cout << "Error: " << __FUNCTION__ << " was called with a minVolume of "
+         << minVolume << ", but the latticeMaxes of spg " << spg
+         << " only allow a volume of up to " << maxProduct << ".\n";
+    return latticeStruct();
+  }
+
+  // Only triclinic and monoclinic angles change the volume, and only they
+  // may need to be drawn again if no lengths can give a volume in the range.
+  const size_t maxAttempts = 1000;
+  for (size_t attempt = 0; attempt < maxAttempts; attempt++) {
+    if (attempt != 0) st = generateLatticeForSpg(spg, mins, maxes);
+
+    double unitVolume = getUnitVolume(st);
+    double volumeLow = unitVolume * minProduct;
+    double volumeHigh = unitVolume * maxProduct;
+    if (minVolume != -1 && minVolume > volumeLow) volumeLow = minVolume;
+    if (maxVolume != -1 && maxVolume < volumeHigh) volumeHigh = maxVolume;
+    if (unitVolume == 0.0 || volumeLow > volumeHigh) {
+      // The angles of the other systems are fixed, so drawing them again
+      // cannot help
+      if (spg > 15) break;
+      continue;
+    }
+
+    // The volume is uniform in the range that these angles can reach.
+    // Dividing by the unit volume gives the product of the lengths.
+    double product = getRandDouble(volumeLow, volumeHigh) / unitVolume;
+
+    // Draw the lengths in a random order, each uniformly in the range that
+    // still leaves room for the others to reach the product. The last one
+    // is solved for. The random order keeps any one axis from being the
+    // one that is always solved for.
+    size_t order[3] = {0, 1, 2};
+    for (size_t i = numLengths; i > 1; i--)
+      swap(order[i - 1], order[getRandInt(0, i - 1)]);
+
+    double values[3];
+    for (size_t i = 0; i < numLengths; i++) {
+      const freeLength& length = lengths[order[i]];
+      // The range of the product of the lengths that are not drawn yet
+      double restMin = 1.0, restMax = 1.0;
+      for (size_t j = i + 1; j < numLengths; j++) {
+        restMin *= power(lengths[order[j]].min, lengths[order[j]].power);
+        restMax *= power(lengths[order[j]].max, lengths[order[j]].power);
+      }
+      double low = root(product / restMax, length.power);
+      double high = (restMin > 0.0) ?
+                    root(product / restMin, length.power) : length.max;
+      if (low < length.min) low = length.min;
+      if (high > length.max) high = length.max;
+      // Only rounding can make these cross
+      if (low > high) low = high;
+
+      double value = (i + 1 == numLengths) ?
+                     root(product, length.power) :
+                     getRandDouble(low, high);
+      if (value < low) value = low;
+      if (value > high) value = high;
+      values[order[i]] = value;
+      product /= power(value, length.power);
+    }
+
+    if (spg <= 74) {
+      st.a = values[0];
+      st.b = values[1];
+      st.c = values[2];
+    }
+    else if (spg <= 194) {
+      st.a = st.b = values[0];
+      st.c = values[1];
+    }
+    else st.a = st.b = st.c = values[0];
+    return st;
+  }
+
+  cout << "Error: " << __FUNCTION__ << " could not find a lattice for spg "
+       << spg << " with a volume between " << minVolume << " and "
+       << maxVolume << " within the given latticeMins and latticeMaxes.\n";
+  return latticeStruct();
+}
+
 string RandSpg::getAtomAssignmentsString(const atomAssignments& a)
 {
   stringstream s;
@@ -899,14 +1056,50 @@ void RandSpg::printAtomAssignments(const atomAssignments& a)
   cout << getAtomAssignmentsString(a);
 }
 
+// Serializes the writes to the log file
+static mutex& getLogFileMutex()
+{
+  static mutex logFileMutex;
+  return logFileMutex;
+}
+
+// The text that this thread is buffering, if it is buffering
+static thread_local bool t_bufferingLog = false;
+static thread_local string t_logBuffer;
+
+void RandSpg::startLogBuffer()
+{
+  t_bufferingLog = true;
+}
+
+void RandSpg::flushLogBuffer()
+{
+  t_bufferingLog = false;
+  if (t_logBuffer.empty()) return;
+  appendToLogFile(t_logBuffer);
+  t_logBuffer.clear();
+}
+
 // The name of the log file is available in the header as an extern
 void RandSpg::appendToLogFile(const std::string& text)
 {
+  if (t_bufferingLog) {
+    t_logBuffer += text;
+    return;
+  }
+
+  appendToLogFile(e_logfilename, text);
+}
+
+void RandSpg::appendToLogFile(const std::string& fileName,
+                              const std::string& text)
+{
+  lock_guard<mutex> lock(getLogFileMutex());
   fstream fs;
-  fs.open(e_logfilename, std::fstream::out | std::fstream::app);
+  fs.open(fileName, std::fstream::out | std::fstream::app);
 
   if (!fs.is_open()) {
-    cout << "Error opening log file, " << e_logfilename << ".\n"
+    cout << "Error opening log file, " << fileName << ".\n"
          << "The program will keep running, but log info will not be written.\n";
     return;
   }
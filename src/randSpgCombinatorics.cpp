@@ -14,13 +14,16 @@
 
  ***********************************************************************/
 
+#include <cstdint>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
 
 #include "rng.h"
 #include "randSpg.h"
 #include "randSpgCombinatorics.h"
-#include "wyckPosTrackingInfo.h"
+#include "systemPossibilityIterator.h"
+#include "systemPossibilitySampler.h"
 
 // For FunctionTracker
 #include "functionTracker.h"
@@ -33,24 +36,22 @@ using namespace std;
 // Define this for debug output
 //#define PRINT_RAND_SPG_COMB_DEBUG
 
-// This is used in 'findAllCombinations()'
-struct combinationSettings {
-  uint numAtoms;
-  bool findOnlyOne;
-  bool findOnlyNonUnique;
-  combinationSettings() :
-    numAtoms(0),
-    findOnlyOne(false),
-    findOnlyNonUnique(false)
-    {}
-  combinationSettings(uint nAtoms, bool findOne, bool findNonUnique) :
-    numAtoms(nAtoms),
-    findOnlyOne(findOne),
-    findOnlyNonUnique(findNonUnique)
-    {}
+// A compact version of the Wyckoff position tracking for the searches below.
+// The positions themselves stay in the spacegroup's table of similar Wyckoff
+// positions, so the tracker only holds integers and may be changed in place.
+struct wyckGroupTracker {
+  uint multiplicity;
+  bool unique;
+  uint numPositions;
+  // The index of the similar Wyckoff positions in getSimilarWyckPositions()
+  uint groupIndex;
+  // The number of times the current atom type uses this group
+  uint numTimesUsed;
+  // The number of times all of the atom types so far use this group
+  uint totalTimesUsed;
 };
 
-typedef std::vector<WyckPosTrackingInfo> usageTracker;
+typedef std::vector<wyckGroupTracker> usageTracker;
 
 #ifdef PRINT_RAND_SPG_COMB_DEBUG
 static inline void printSingleAtomPossibility(const singleAtomPossibility&
@@ -111,61 +112,35 @@ static bool vecContains(const vector<T>& vec, const T& element)
   return false;
 }
 
-static inline uint getNumAtomsUsed(const usageTracker& tracker)
-{
-  size_t sum = 0;
-  for (size_t i = 0; i < tracker.size(); i++)
-    sum += ((tracker[i].multiplicity) * tracker[i].numTimesUsed);
-  return sum;
-}
-
-static inline int getFirstAvailableIndex(const usageTracker& tracker)
-{
-  for (size_t i = 0; i < tracker.size(); i++) {
-    if (tracker[i].keepUsing) return i;
-  }
-  // Could not find an available position
-  return -1;
-}
-
-static inline uint getNumAtomsLeft(const usageTracker& tracker, uint numAtoms)
-{
-  uint numAtomsUsed = getNumAtomsUsed(tracker);
-  uint numAtomsLeft = numAtoms - numAtomsUsed;
-  return numAtomsLeft;
-}
-
-static inline bool positionIsUsable(const WyckPosTrackingInfo& info,
+static inline bool positionIsUsable(const wyckGroupTracker& info,
                                     uint numAtomsLeft, bool findOnlyNonUnique)
 {
-  size_t multiplicity = info.multiplicity;
-
   // If we are only looking for non unique positions and the position is unique,
   // return false
   if (findOnlyNonUnique && info.unique) return false;
 
-  // If we have a smaller multiplicity than the number of atoms left
-  if (multiplicity <= numAtomsLeft && info.keepUsing &&
-      // And if it it is not unique or we are not already using it more than
-      // we can
-      (!info.unique || info.numTimesUsed < info.getNumPositions()))
-    // Use it!
-    return true;
-  return false;
+  // If we have a larger multiplicity than the number of atoms left, we
+  // can't use it
+  if (info.multiplicity > numAtomsLeft) return false;
+
+  // If it is unique, we can't use it more times than there are positions.
+  // This includes the times that previous atom types used it.
+  return !info.unique || info.totalTimesUsed < info.numPositions;
 }
 
 static inline singleAtomPossibility
-convertToPossibility(const usageTracker& tempTracker, uint atomicNum)
+convertToPossibility(const vector<uint>& numTimesUsed,
+                     const vector<similarWyckPositions>& similarWyckPos,
+                     uint atomicNum)
 {
   singleAtomPossibility poss;
   poss.atomicNum = atomicNum;
-  for (size_t i = 0; i < tempTracker.size(); i++) {
-    const WyckPosTrackingInfo& info = tempTracker[i];
-    if (info.numTimesUsed == 0) continue;
+  for (size_t i = 0; i < numTimesUsed.size(); i++) {
+    if (numTimesUsed[i] == 0) continue;
 
     similarWyckPosAndNumToChoose temp;
-    temp.numToChoose = info.numTimesUsed;
-    temp.choosablePositions = info.getPositions();
+    temp.numToChoose = numTimesUsed[i];
+    temp.choosablePositions = similarWyckPos[i];
     poss.assigns.push_back(temp);
   }
   return poss;
@@ -183,21 +158,22 @@ static inline bool wyckPositionsAreSimilar(const wyckPos& wyckPos1,
   return false;
 }
 
-// Takes a Wyckoff vector and groups similar Wyckoff positions together
-// Stores the similar Wyckoff positions as a vector
-static vector<vector<wyckPos>> groupSimilarWyckPositions(
-                                               const wyckoffPositions& wyckVec)
+// Takes the Wyckoff vector of a spacegroup and groups similar Wyckoff
+// positions together
+// Stores the handles of the similar Wyckoff positions as a vector
+static vector<similarWyckPositions> groupSimilarWyckPositions(uint spg)
 {
+  const wyckoffPositions& wyckVec = RandSpg::getWyckoffPositions(spg);
   vector<char> wyckPositionsUsed;
-  vector<vector<wyckPos>> ret;
+  vector<similarWyckPositions> ret;
   for (size_t i = 0; i < wyckVec.size(); i++) {
     const wyckPos& pos_i = wyckVec[i];
     char wyckLet = RandSpg::getWyckLet(pos_i);
     // If we've already used this one, don't include it
     if (!vecContains<char>(wyckPositionsUsed, wyckLet)) {
       wyckPositionsUsed.push_back(wyckLet);
-      vector<wyckPos> tempVec;
-      tempVec.push_back(pos_i);
+      similarWyckPositions tempVec;
+      tempVec.push_back(RandSpg::getWyckHandle(spg, i));
       // Add on similar positions
       for (size_t j = i + 1; j < wyckVec.size(); j++) {
         const wyckPos& pos_j = wyckVec[j];
@@ -207,7 +183,7 @@ static vector<vector<wyckPos>> groupSimilarWyckPositions(
         if (wyckPositionsAreSimilar(pos_i, pos_j) &&
             !vecContains<char>(wyckPositionsUsed, wyckLet_j)) {
           wyckPositionsUsed.push_back(wyckLet_j);
-          tempVec.push_back(pos_j);
+          tempVec.push_back(RandSpg::getWyckHandle(spg, j));
         }
       }
       ret.push_back(tempVec);
@@ -216,207 +192,220 @@ static vector<vector<wyckPos>> groupSimilarWyckPositions(
   return ret;
 }
 
-// Create a basic usage tracker from the wyckoff positions
-static usageTracker createUsageTracker(const wyckoffPositions& wyckVec)
+const vector<similarWyckPositions>&
+RandSpgCombinatorics::getSimilarWyckPositions(uint spg)
+{
+  // The groups of every spacegroup are only created once. The local static
+  // is initialized in a thread-safe way.
+  static const vector<vector<similarWyckPositions>> allSimilarWyckPositions =
+    []()
+    {
+      vector<vector<similarWyckPositions>> ret(231);
+      for (uint i = 1; i <= 230; i++)
+        ret[i] = groupSimilarWyckPositions(i);
+      return ret;
+    }();
+
+  if (spg < 1 || spg > 230) {
+    // This prints the error message
+    RandSpg::getWyckoffPositions(spg);
+    return allSimilarWyckPositions[0];
+  }
+  return allSimilarWyckPositions[spg];
+}
+
+// Create a usage tracker for the unique groups of the similar Wyckoff
+// positions
+static usageTracker createUniqueUsageTracker(
+                      const vector<similarWyckPositions>& similarWyckPos)
 {
   usageTracker tracker;
-  tracker.reserve(wyckVec.size());
-  vector<vector<wyckPos>> similarWyckPos = groupSimilarWyckPositions(wyckVec);
   for (size_t i = 0; i < similarWyckPos.size(); i++) {
-    WyckPosTrackingInfo info(similarWyckPos[i]);
+    if (!RandSpg::containsUniquePosition(similarWyckPos[i][0])) continue;
+    wyckGroupTracker info;
+    info.multiplicity = RandSpg::getMultiplicity(similarWyckPos[i][0]);
+    info.unique = true;
+    info.numPositions = similarWyckPos[i].size();
+    info.groupIndex = i;
+    info.numTimesUsed = 0;
+    info.totalTimesUsed = 0;
     tracker.push_back(info);
   }
   return tracker;
 }
 
-static inline usageTracker createUsageTracker(uint spg)
+// Finds every way to place up to 'numAtomsLeft' atoms of one type in the
+// groups of the tracker, starting with the group at 'firstAvailable'. The
+// tracker is changed in place and restored before returning, so nothing is
+// copied along the way. Once every group has been considered, 'found' is
+// called with the tracker and the number of atoms that are left over. It
+// decides if those can be placed elsewhere. If it returns true, the search
+// stops early and this returns true.
+template <typename Callback>
+static bool findAllCombinations(usageTracker& tracker,
+                                size_t firstAvailable,
+                                uint numAtomsLeft,
+                                bool findOnlyNonUnique,
+                                Callback& found)
 {
-  return createUsageTracker(RandSpg::getWyckoffPositions(spg));
-}
-
-// Checks to see if the Wyckoff positions in a similar wyckoff vector
-// are unique or not
-static inline bool similarWyckPosAndNumToChooseIsUnique(const similarWyckPosAndNumToChoose& s)
-{
-  if (s.choosablePositions.size() == 0) return false;
-  return RandSpg::containsUniquePosition(s.choosablePositions[0]);
-}
+  START_FT;
+  if (firstAvailable == tracker.size()) return found(tracker, numAtomsLeft);
 
-// Check to make sure we don't use more unique positions than are available
-// in a single atom possibility
-static inline bool moreUniquePositionsUsedThanAvailable(const singleAtomPossibility& poss)
-{
-  const assignments& assigns = poss.assigns;
-  for (size_t i = 0; i < assigns.size(); i++) {
-    // Check to see if our similar Wyck positions are unique
-    if (similarWyckPosAndNumToChooseIsUnique(assigns[i])) {
-      // If they are, find the number to choose and the number available
-      uint numToChoose = assigns[i].numToChoose;
-      uint numAvailable = assigns[i].choosablePositions.size();
-      // If we have to choose more than we have available, return true
-      if (numToChoose > numAvailable) return true;
-    }
-  }
-  return false;
-}
+  wyckGroupTracker& info = tracker[firstAvailable];
 
-static inline uint numTimesAPositionIsUsed(const singleAtomPossibility& sPoss,
-                                           const similarWyckPositions& simPos)
-{
-  uint numTimesUsed = 0;
-  for (size_t i = 0; i < sPoss.assigns.size(); i++) {
-    if (sPoss.assigns[i].choosablePositions == simPos) {
-      numTimesUsed += sPoss.assigns[i].numToChoose;
-    }
+  // Check to see if we can use the first available position ('again', if
+  // it has already been used). Find all possible combinations while using it
+  // if we can
+  if (positionIsUsable(info, numAtomsLeft, findOnlyNonUnique)) {
+    info.numTimesUsed++;
+    info.totalTimesUsed++;
+    bool done = findAllCombinations(tracker, firstAvailable,
+                                    numAtomsLeft - info.multiplicity,
+                                    findOnlyNonUnique, found);
+    info.numTimesUsed--;
+    info.totalTimesUsed--;
+    if (done) return true;
   }
-  return numTimesUsed;
-}
 
-// This should only be called to compare Wyckoff positions generated
-// from the same spacegroup
-// This assumes
-static inline bool tooManyOfAUniquePositionUsed(const systemPossibility& s)
-{
-  for (size_t i = 0; i < s.size(); i++) {
-    // Check to make sure the single atom possibility doesn't use
-    // too many unique positions
-    if (moreUniquePositionsUsedThanAvailable(s[i])) return true;
-    const assignments& assigns = s[i].assigns;
-    for (size_t j = 0; j < assigns.size(); j++) {
-      const similarWyckPosAndNumToChoose& simPos = assigns[j];
-      if (similarWyckPosAndNumToChooseIsUnique(simPos)) {
-        uint numTimesUsed = simPos.numToChoose;
-        // We need to loop through the other system possibilities and count the
-        // number of times each one of them uses this position
-        for (size_t k = i + 1; k < s.size(); k++) {
-          numTimesUsed += numTimesAPositionIsUsed(s[k], simPos.choosablePositions);
-        }
-        // If, in total, we used too many of a unique position, return true
-        if (numTimesUsed > simPos.choosablePositions.size()) return true;
+  // Find all possible combinations without using this position ('again', if
+  // it has already been used).
+  return findAllCombinations(tracker, firstAvailable + 1, numAtomsLeft,
+                             findOnlyNonUnique, found);
+}
+
+// Searches for a single system possibility. The atom types are placed one
+// at a time. When an atom type cannot be placed, the search goes back to try
+// the next combination of the previous one.
+//
+// Only the unique positions limit the following atom types, so only those
+// are searched with findAllCombinations(). Whether the atoms that are left
+// over fit in the non-unique positions is looked up in a table. So the
+// search does not depend on how many ways there are to fill the non-unique
+// positions. The uses of the unique positions that could not be finished
+// are remembered and not tried again.
+class oneSystemPossibilitySearch {
+ public:
+  oneSystemPossibilitySearch(uint spg,
+                             const vector<numAndType>& numOfEachType,
+                             bool findOnlyNonUnique) :
+    m_similarWyckPos(RandSpgCombinatorics::getSimilarWyckPositions(spg)),
+    m_types(numOfEachType),
+    m_findOnlyNonUnique(findOnlyNonUnique),
+    m_tracker(createUniqueUsageTracker(m_similarWyckPos)),
+    m_nonUniqueFits(),
+    m_nonUniqueGroupToUse(),
+    m_typeIndex(0),
+    m_savedTimesUsed(m_types.size(), vector<uint>(m_tracker.size())),
+    m_failed(m_types.size()),
+    m_sysPos()
+  {
+    uint maxNumAtoms = 0;
+    for (size_t i = 0; i < m_types.size(); i++)
+      maxNumAtoms = max(maxNumAtoms, m_types[i].first);
+
+    // For every number of atoms, find if it fits in the non-unique
+    // positions, and the last group to put them in if it does
+    m_nonUniqueFits.assign(maxNumAtoms + 1, false);
+    m_nonUniqueGroupToUse.assign(maxNumAtoms + 1, 0);
+    m_nonUniqueFits[0] = true;
+    for (uint n = 1; n <= maxNumAtoms; n++) {
+      for (size_t i = 0; i < m_similarWyckPos.size(); i++) {
+        wyckHandle pos = m_similarWyckPos[i][0];
+        if (RandSpg::containsUniquePosition(pos)) continue;
+        uint mult = RandSpg::getMultiplicity(pos);
+        if (mult == 0 || mult > n || !m_nonUniqueFits[n - mult]) continue;
+        m_nonUniqueFits[n] = true;
+        m_nonUniqueGroupToUse[n] = i;
+        break;
       }
     }
   }
-  return false;
-}
 
-systemPossibilities joinSingleWithSystem(const singleAtomPossibilities& saPoss,
-                                         const systemPossibilities& sysPoss)
-{
-  START_FT;
-  systemPossibilities newSysPossibilities;
-
-  // If sysPoss is empty, then our job is easy
-  if (sysPoss.size() == 0) {
-    for (size_t i = 0; i < saPoss.size(); i++) {
-      systemPossibility tempSysPossibility;
-      tempSysPossibility.push_back(saPoss[i]);
-      // We're assuming the single atom possibility has already been
-      // checked internally for uniqueness violations
-      newSysPossibilities.push_back(tempSysPossibility);
-    }
-    return newSysPossibilities;
+  // Returns true if a system possibility was found
+  bool search()
+  {
+    if (m_types.empty()) return false;
+    return searchType(0);
   }
 
-  // We're going to add a single atom possibilities to all of the system
-  // possibilities
-  for (size_t i = 0; i < sysPoss.size(); i++) {
-    for (size_t j = 0; j < saPoss.size(); j++) {
-      systemPossibility tempSysPoss = sysPoss[i];
-      // Add this to the system possibility
-      tempSysPoss.push_back(saPoss[j]);
-      // Only add it if too many of a unique position is NOT used
-      // If it violates the uniqueness rule, we can't use it
-      if (!tooManyOfAUniquePositionUsed(tempSysPoss))
-        newSysPossibilities.push_back(tempSysPoss);
+  const systemPossibility& getSystemPossibility() const {return m_sysPos;};
+
+  // Called by findAllCombinations() when the unique positions of the
+  // current atom type have been chosen
+  bool operator()(const usageTracker& tracker, uint numAtomsLeft)
+  {
+    if (!m_nonUniqueFits[numAtomsLeft]) return false;
+
+    // Put the rest of the atoms in the non-unique positions
+    vector<uint> numTimesUsed(m_similarWyckPos.size(), 0);
+    for (size_t i = 0; i < tracker.size(); i++)
+      numTimesUsed[tracker[i].groupIndex] = tracker[i].numTimesUsed;
+    while (numAtomsLeft != 0) {
+      size_t groupIndex = m_nonUniqueGroupToUse[numAtomsLeft];
+      numTimesUsed[groupIndex]++;
+      numAtomsLeft -= RandSpg::getMultiplicity(m_similarWyckPos[groupIndex][0]);
     }
+
+    m_sysPos.push_back(convertToPossibility(numTimesUsed, m_similarWyckPos,
+                                            m_types[m_typeIndex].second));
+    if (searchType(m_typeIndex + 1)) return true;
+    m_sysPos.pop_back();
+    return false;
   }
-  return newSysPossibilities;
-}
 
-// This will only throw if "findOnlyOne" is set to be true
-// If that is the case, it may throw a single atom possibility (the possibility
-// that it finds successfully)
-// onlyNonUnique should typically be set to 'true' if findOnlyOne is true unless
-// we are looking for the last atom combination
-// This will ensure that a combination will be found
-static void findAllCombinations(singleAtomPossibilities& appendVec,
-                                usageTracker tracker,
-                                uint atomicNum,
-                                const combinationSettings& sets)
-{
-  START_FT;
-  if (sets.numAtoms == 0) return;
+ private:
+  bool searchType(size_t typeIndex)
+  {
+    if (typeIndex == m_types.size()) return true;
 
-  uint numAtomsLeft = getNumAtomsLeft(tracker, sets.numAtoms);
-  // Returns -1 if no index is available
-  int firstAvailableIndex = getFirstAvailableIndex(tracker);
+    uint64_t state = getUniqueState();
+    if (m_failed[typeIndex].count(state) != 0) return false;
 
-  if (firstAvailableIndex == -1) return;
+    // Start the counts of this atom type at zero, and restore the counts of
+    // the previous one afterwards
+    vector<uint>& saved = m_savedTimesUsed[typeIndex];
+    for (size_t i = 0; i < m_tracker.size(); i++) {
+      saved[i] = m_tracker[i].numTimesUsed;
+      m_tracker[i].numTimesUsed = 0;
+    }
 
-  WyckPosTrackingInfo info = tracker[firstAvailableIndex];
-  size_t firstMultiplicity = info.multiplicity;
+    size_t previousTypeIndex = m_typeIndex;
+    m_typeIndex = typeIndex;
+    bool found = findAllCombinations(m_tracker, 0,
+                                     m_types[typeIndex].first,
+                                     m_findOnlyNonUnique, *this);
+    m_typeIndex = previousTypeIndex;
 
-  // Check to see if we can use the first available position ('again', if
-  // it has already been used). Find all possible combinations while using it
-  // if we can
-  if (positionIsUsable(info, numAtomsLeft, sets.findOnlyNonUnique)) {
-    usageTracker tempTracker = tracker;
-    tempTracker[firstAvailableIndex].numTimesUsed += 1;
-
-    // If we have used all the atoms, append this possibility to the vector
-    if (getNumAtomsLeft(tempTracker, sets.numAtoms) == 0) {
-      // If we are to only find one, we are done. Easiest way to get out
-      // of here is to throw an exception and catch it on the outside.
-      if (sets.findOnlyOne) throw convertToPossibility(tempTracker, atomicNum);
-      appendVec.push_back(convertToPossibility(tempTracker, atomicNum));
-    }
+    for (size_t i = 0; i < m_tracker.size(); i++)
+      m_tracker[i].numTimesUsed = saved[i];
 
-    // Otherwise, keep on checking for more possibilities!
-    else findAllCombinations(appendVec, tempTracker, atomicNum, sets);
+    if (!found) m_failed[typeIndex].insert(state);
+    return found;
   }
 
-  // Find all possible combinations without using this position ('again', if
-  // it has already been used).
-  tracker[firstAvailableIndex].keepUsing = false;
-  findAllCombinations(appendVec, tracker, atomicNum, sets);
-}
-
-static void findOnlyOneCombinationIfPossible(singleAtomPossibilities& appendVec,
-                                             usageTracker tracker,
-                                             uint atomicNum,
-                                             const combinationSettings& sets,
-                                             bool finalAtom)
-{
-  START_FT;
-  // If we use 'findOnlyOne', then findAllCombinations() will throw the
-  // possibility when it is found
-  try {
-    // We will only look at unique possibilities if we are on the final
-    // type of atom. This prevents us from getting accidentally 'stuck'
-    // by filling up unique positions with something that doesn't need
-    // them
-    combinationSettings tempSets = sets;
-    tempSets.findOnlyOne = true;
-    tempSets.findOnlyNonUnique = true;
-    // If the parameter of this function says to only look at non unique
-    // items, then that overrides this
-    if (sets.findOnlyNonUnique); // Do nothing
-    // If we are looking at the final atom, we may use a non unique setup
-    else if (finalAtom) tempSets.findOnlyNonUnique = false;
-    findAllCombinations(appendVec, tracker, atomicNum, tempSets);
-    // If we can't find any, then proceed with the normal algorithm
-    if (appendVec.size() == 0) {
-      tempSets.findOnlyOne = false;
-      tempSets.findOnlyNonUnique = sets.findOnlyNonUnique;
-      findAllCombinations(appendVec, tracker, atomicNum, tempSets);
+  // A mixed-radix number of how many times each unique group has been used
+  uint64_t getUniqueState() const
+  {
+    uint64_t state = 0;
+    for (size_t i = 0; i < m_tracker.size(); i++) {
+      state = state * (m_tracker[i].numPositions + 1) +
+              m_tracker[i].totalTimesUsed;
     }
+    return state;
   }
-  // If we caught a possibility, then that's the one we're gonna use!
-  catch (singleAtomPossibility pos) {
-    appendVec.clear();
-    appendVec.push_back(pos);
-  }
-}
+
+  const vector<similarWyckPositions>& m_similarWyckPos;
+  vector<numAndType> m_types;
+  bool m_findOnlyNonUnique;
+  // Only has the unique groups
+  usageTracker m_tracker;
+  vector<bool> m_nonUniqueFits;
+  vector<size_t> m_nonUniqueGroupToUse;
+  size_t m_typeIndex;
+  vector<vector<uint>> m_savedTimesUsed;
+  vector<unordered_set<uint64_t>> m_failed;
+  systemPossibility m_sysPos;
+};
 
 // Returns all system possibilities that can be found
 systemPossibilities
@@ -426,40 +415,28 @@ RandSpgCombinatorics::getSystemPossibilities(uint spg,
                                              bool findOnlyNonUnique)
 {
   START_FT;
-  vector<numAndType> numOfEachType = RandSpg::getNumOfEachType(atoms);
-
   systemPossibilities sysPossibilities;
-  sysPossibilities.reserve(numOfEachType.size());
-
-  for (size_t i = 0; i < numOfEachType.size(); i++) {
 
-    uint atomicNum = numOfEachType[i].second;
-
-    // Create inputs for 'findAllCombinations()'
-    singleAtomPossibilities saPossibilities;
-    usageTracker tracker = createUsageTracker(spg);
-    uint numAtoms = numOfEachType[i].first;
-
-    combinationSettings sets(numAtoms, findOnlyOne, findOnlyNonUnique);
+  // Stop at the first system possibility that is found
+  if (findOnlyOne) {
+    oneSystemPossibilitySearch search(spg, RandSpg::getNumOfEachType(atoms),
+                                      findOnlyNonUnique);
+    if (search.search())
+      sysPossibilities.push_back(search.getSystemPossibility());
+    return sysPossibilities;
+  }
 
-    bool last = (i == numOfEachType.size() - 1);
-    // This appends all possibilities found to 'saPossibilities'
-    if (findOnlyOne)
-      findOnlyOneCombinationIfPossible(saPossibilities, tracker, atomicNum, sets, last);
-    else findAllCombinations(saPossibilities, tracker, atomicNum, sets);
+  // Walk through the possibilities one at a time rather than joining every
+  // single atom possibility with every partial system
+  SystemPossibilitySampler sampler(spg, atoms);
+  if (findOnlyNonUnique) sampler.excludeUniqueWyckPos();
 
-    // If we didn't find any single atom possibilities, we won't find any
-    // system possibilities either. Return empty
-    if (saPossibilities.size() == 0) return systemPossibilities();
+  double numPossibilities = sampler.getNumPossibilities();
+  if (numPossibilities == 0) return sysPossibilities;
 
-#ifdef PRINT_RAND_SPG_COMB_DEBUG
-    cout << "For atomic num '" << atomicNum << "' calling "
-         << "printSingleAtomPossibilities()\n";
-    printSingleAtomPossibilities(saPossibilities);
-#endif
-
-    sysPossibilities = joinSingleWithSystem(saPossibilities, sysPossibilities);
-  }
+  sysPossibilities.reserve(numPossibilities);
+  for (SystemPossibilityIterator it(sampler); !it.atEnd(); it.next())
+    sysPossibilities.push_back(*it);
 
 #ifdef PRINT_RAND_SPG_COMB_DEBUG
   printSystemPossibilities(sysPossibilities);
@@ -468,6 +445,16 @@ RandSpgCombinatorics::getSystemPossibilities(uint spg,
   return sysPossibilities;
 }
 
+bool RandSpgCombinatorics::systemPossibilityExists(
+                                      uint spg,
+                                      const vector<numAndType>& numOfEachType,
+                                      bool findOnlyNonUnique)
+{
+  START_FT;
+  oneSystemPossibilitySearch search(spg, numOfEachType, findOnlyNonUnique);
+  return search.search();
+}
+
 uint countNumTimesWyckPosMayBeUsed(const systemPossibility& sysPos,
                                    char wyckLet)
 {
@@ -479,7 +466,7 @@ uint countNumTimesWyckPosMayBeUsed(const systemPossibility& sysPos,
       uint numToChoose = assigns[j].numToChoose;
       const similarWyckPositions& cp = assigns[j].choosablePositions;
       for (size_t k = 0; k < cp.size(); k++) {
-        const wyckPos& wp = cp[k];
+        wyckHandle wp = cp[k];
         if (RandSpg::getWyckLet(wp) == wyckLet) {
           // If this is a unique wyckoff position, we may only use it once
           if (RandSpg::containsUniquePosition(wp)) return 1;
@@ -506,7 +493,7 @@ uint countNumTimesWyckPosMayBeUsedForSpecificAtom(
       uint numToChoose = assigns[j].numToChoose;
       const similarWyckPositions& cp = assigns[j].choosablePositions;
       for (size_t k = 0; k < cp.size(); k++) {
-        const wyckPos& wp = cp[k];
+        wyckHandle wp = cp[k];
         if (RandSpg::getWyckLet(wp) == wyckLet) {
           // If this is a unique wyckoff position, we may only use it once
           if (RandSpg::containsUniquePosition(wp)) return 1;
@@ -518,6 +505,24 @@ uint countNumTimesWyckPosMayBeUsedForSpecificAtom(
   }
   return numTimesUsed;
 }
+bool RandSpgCombinatorics::possibilityHasWyckPos(
+                                          const systemPossibility& sysPos,
+                                          char wyckLet,
+                                          uint minNumUses)
+{
+  return countNumTimesWyckPosMayBeUsed(sysPos, wyckLet) >= minNumUses;
+}
+
+bool RandSpgCombinatorics::possibilityHasWyckPos(
+                                          const systemPossibility& sysPos,
+                                          char wyckLet,
+                                          uint minNumUses,
+                                          uint atomicNum)
+{
+  return countNumTimesWyckPosMayBeUsedForSpecificAtom(sysPos, wyckLet,
+                                                      atomicNum) >= minNumUses;
+}
+
 systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(
                                           const systemPossibilities& sysPos,
                                           char wyckLet,
@@ -525,8 +530,8 @@ systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(
 {
   systemPossibilities ret;
   for (size_t i = 0; i < sysPos.size(); i++) {
-    uint numTimesUsed = countNumTimesWyckPosMayBeUsed(sysPos[i], wyckLet);
-    if (numTimesUsed >= minNumUses) ret.push_back(sysPos[i]);
+    if (possibilityHasWyckPos(sysPos[i], wyckLet, minNumUses))
+      ret.push_back(sysPos[i]);
   }
   return ret;
 }
@@ -540,8 +545,8 @@ systemPossibilities RandSpgCombinatorics::removePossibilitiesWithoutWyckPos(
 {
   systemPossibilities ret;
   for (size_t i = 0; i < sysPos.size(); i++) {
-    uint numTimesUsed = countNumTimesWyckPosMayBeUsedForSpecificAtom(sysPos[i], wyckLet, atomicNum);
-    if (numTimesUsed >= minNumUses) ret.push_back(sysPos[i]);
+    if (possibilityHasWyckPos(sysPos[i], wyckLet, minNumUses, atomicNum))
+      ret.push_back(sysPos[i]);
   }
   return ret;
 }
@@ -587,7 +592,7 @@ systemPossibility RandSpgCombinatorics::getRandomSystemPossibility(const systemP
 //   return getRandomAtomAssignments(sysPoss, vector<pair<uint, wyckPos>>());
 // }
 
-void decrementChoiceFromSystemPossibility(systemPossibility& sysPos, uint atomicNum, const wyckPos& wyckPos)
+void decrementChoiceFromSystemPossibility(systemPossibility& sysPos, uint atomicNum, wyckHandle wyckPos)
 {
   // Remove this from the system possibility
   for (size_t i = 0; i < sysPos.size(); i++) {
@@ -612,16 +617,21 @@ void decrementChoiceFromSystemPossibility(systemPossibility& sysPos, uint atomic
   }
 }
 
-atomAssignments RandSpgCombinatorics::getRandomAtomAssignments(const systemPossibilities& sysPoss, const vector<pair<uint, wyckPos>>& forcedWyckPositions)
+atomAssignments RandSpgCombinatorics::getRandomAtomAssignments(const systemPossibilities& sysPoss, const vector<pair<uint, wyckHandle>>& forcedWyckPositions)
 {
   START_FT;
-  atomAssignments ret;
   // Pick a random system possibility to use
-  systemPossibility tempPos = getRandomSystemPossibility(sysPoss);
+  return getRandomAtomAssignmentsFromPossibility(getRandomSystemPossibility(sysPoss), forcedWyckPositions);
+}
+
+atomAssignments RandSpgCombinatorics::getRandomAtomAssignmentsFromPossibility(systemPossibility tempPos, const vector<pair<uint, wyckHandle>>& forcedWyckPositions)
+{
+  START_FT;
+  atomAssignments ret;
 
   // Add the forced Wyckoff positions
   for (size_t i = 0; i < forcedWyckPositions.size(); i++) {
-    wyckPos pos = forcedWyckPositions[i].second;
+    wyckHandle pos = forcedWyckPositions[i].second;
     uint atomicNum = forcedWyckPositions[i].first;
     ret.push_back(make_pair(pos, atomicNum));
     decrementChoiceFromSystemPossibility(tempPos, atomicNum, pos);
@@ -636,8 +646,8 @@ atomAssignments RandSpgCombinatorics::getRandomAtomAssignments(const systemPossi
       // Keep adding atoms until there are none left
       while (atomsLeft > 0) {
         int rand = getRandInt(0, simPos.size() - 1);
-        const wyckPos& wyckPos = simPos[rand];
-        ret.push_back(make_pair(simPos[rand], atomicNum));
+        wyckHandle wyckPos = simPos[rand];
+        ret.push_back(make_pair(wyckPos, atomicNum));
         atomsLeft--;
         // If we used a unique position, then remove all of this position from
         // the rest of the choices so we don't accidentally re-use it
@@ -708,31 +718,36 @@ string RandSpgCombinatorics::getSystemPossibilitiesString(const systemPossibilit
   return s.str();
 }
 
-string RandSpgCombinatorics::getVerbosePossibilitiesString(const systemPossibilities& pos)
+string RandSpgCombinatorics::getVerbosePossibilityString(const systemPossibility& sysPos, size_t index)
 {
   stringstream s;
-  s << "Printing system possibilities:\n";
-  for (size_t i = 0; i < pos.size(); i++) {
-    const systemPossibility& sysPos = pos[i];
-    s << "  Possibility " << i+1 << ":\n";
-    for (size_t j = 0; j < sysPos.size(); j++) {
-      const singleAtomPossibility& sinPos = sysPos[j];
-      s << "    For atomicNum: " << sinPos.atomicNum << "\n";
-      for (size_t k = 0; k < sinPos.assigns.size(); k++) {
-        const similarWyckPosAndNumToChoose& simPos = sinPos.assigns[k];
-        s << "      We will choose " << simPos.numToChoose
-          << " of the following positions:\n        { ";
-        for (size_t l = 0; l < simPos.choosablePositions.size(); l++) {
-          s << RandSpg::getWyckLet(simPos.choosablePositions[l]) << " ";
-        }
-        s << "}\n";
-        if (simPos.choosablePositions.size() != 0)
-          s << "        uniqueness is: "
-            << (RandSpg::containsUniquePosition(simPos.choosablePositions[0]) ? "true - positions are not re-usable\n" : "false - positions are re-usable\n");
+  s << "  Possibility " << index+1 << ":\n";
+  for (size_t j = 0; j < sysPos.size(); j++) {
+    const singleAtomPossibility& sinPos = sysPos[j];
+    s << "    For atomicNum: " << sinPos.atomicNum << "\n";
+    for (size_t k = 0; k < sinPos.assigns.size(); k++) {
+      const similarWyckPosAndNumToChoose& simPos = sinPos.assigns[k];
+      s << "      We will choose " << simPos.numToChoose
+        << " of the following positions:\n        { ";
+      for (size_t l = 0; l < simPos.choosablePositions.size(); l++) {
+        s << RandSpg::getWyckLet(simPos.choosablePositions[l]) << " ";
       }
+      s << "}\n";
+      if (simPos.choosablePositions.size() != 0)
+        s << "        uniqueness is: "
+          << (RandSpg::containsUniquePosition(simPos.choosablePositions[0]) ? "true - positions are not re-usable\n" : "false - positions are re-usable\n");
     }
-    s << "  End of possibility " << i+1 << "\n\n";
   }
+  s << "  End of possibility " << index+1 << "\n\n";
+  return s.str();
+}
+
+string RandSpgCombinatorics::getVerbosePossibilitiesString(const systemPossibilities& pos)
+{
+  stringstream s;
+  s << "Printing system possibilities:\n";
+  for (size_t i = 0; i < pos.size(); i++)
+    s << getVerbosePossibilityString(pos[i], i);
   return s.str();
 }
 
@@ -0,0 +1,116 @@
+/**********************************************************************
+  randSpgContext.cpp - Class that holds the state of one generation: the
+                       radii, the custom minIADs, the random number stream,
+                       and where the log goes
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <iostream>
+
+#include "elemInfo.h"
+#include "randSpgContext.h"
+
+using namespace std;
+
+RandSpgContext::RandSpgContext(const randSpgInput& input) :
+  m_covalentRadii(ElemInfoDatabase::_covalentRadii),
+  m_vdwRadii(ElemInfoDatabase::_vdwRadii),
+  m_customMinIADs(),
+  m_logSink([](const string& text) {RandSpg::appendToLogFile(text);}),
+  m_randStream(getRandEngine())
+{
+  // These are applied in the same order as they used to be applied to
+  // ElemInfo: scaling factor, min radius, then the explicit radii
+  for (size_t i = 1; i < m_covalentRadii.size(); i++) {
+    m_covalentRadii[i] *= input.IADScalingFactor;
+    m_vdwRadii[i] *= input.IADScalingFactor;
+    if (m_covalentRadii[i] < input.minRadius)
+      m_covalentRadii[i] = input.minRadius;
+    if (m_vdwRadii[i] < input.minRadius) m_vdwRadii[i] = input.minRadius;
+  }
+
+  for (size_t i = 0; i < input.manualAtomicRadii.size(); i++) {
+    uint atomicNum = input.manualAtomicRadii[i].first;
+    double radius = input.manualAtomicRadii[i].second;
+    if (atomicNum == 0 || atomicNum >= m_covalentRadii.size()) {
+      cout << "Error: Invalid atomicNum, " << atomicNum << ", was entered in "
+           << __FUNCTION__ << "!\n";
+      continue;
+    }
+    if (radius < 0) {
+      cout << "Error in " << __FUNCTION__ << ": a negative radius, '"
+           << radius << "', was entered.\n";
+      continue;
+    }
+    m_covalentRadii[atomicNum] = radius;
+    m_vdwRadii[atomicNum] = radius;
+  }
+
+  for (size_t i = 0; i < input.customMinIADs.size(); i++) {
+    uint atomicNum1 = input.customMinIADs[i].first.first;
+    uint atomicNum2 = input.customMinIADs[i].first.second;
+    if (getCustomMinIAD(atomicNum1, atomicNum2) != -1.0) {
+      cout << "Error: Pair of atomic numbers: (" << atomicNum1 << ","
+           << atomicNum2 << ") have already been entered as a custom pair!\n"
+           << "Ignoring this new custom minIAD.\n";
+      continue;
+    }
+    m_customMinIADs.push_back(input.customMinIADs[i]);
+  }
+}
+
+double RandSpgContext::getRadius(uint atomicNum, bool usingVdwRadii) const
+{
+  const vector<double>& radii = usingVdwRadii ? m_vdwRadii : m_covalentRadii;
+  if (atomicNum == 0 || atomicNum >= radii.size()) {
+    cout << "Error: Invalid atomicNum, " << atomicNum << ", was entered in "
+         << __FUNCTION__ << "!\n";
+    return 0;
+  }
+  return radii[atomicNum];
+}
+
+double RandSpgContext::getCustomMinIAD(uint atomicNum1, uint atomicNum2) const
+{
+  for (size_t i = 0; i < m_customMinIADs.size(); ++i) {
+    if ((m_customMinIADs[i].first.first == atomicNum1 &&
+         m_customMinIADs[i].first.second == atomicNum2) ||
+        (m_customMinIADs[i].first.first == atomicNum2 &&
+         m_customMinIADs[i].first.second == atomicNum1)) {
+      return m_customMinIADs[i].second;
+    }
+  }
+  return -1.0;
+}
+
+shared_ptr<const MinIADTable>
+RandSpgContext::createMinIADTable(const vector<uint>& atoms,
+                                  bool usingVdwRadii) const
+{
+  return make_shared<const MinIADTable>(
+           atoms, usingVdwRadii ? m_vdwRadii : m_covalentRadii,
+           m_customMinIADs);
+}
+
+void RandSpgContext::setLogFile(const string& fileName)
+{
+  m_logSink = [fileName](const string& text)
+  {
+    RandSpg::appendToLogFile(fileName, text);
+  };
+}
+
+void RandSpgContext::appendToLog(const string& text) const
+{
+  if (m_logSink) m_logSink(text);
+}
@@ -46,6 +46,11 @@ m_maxVolume(-1),
 m_maxAttempts(100),
 m_outputDir("."),
 m_verbosity('r'),
+m_seed(0),
+m_numThreads(0),
+m_backtrackDepth(0),
+m_backtrackRetries(3),
+m_placeByDifficulty(false),
 m_optionsAreValid(true)
 {
 
@@ -296,6 +301,29 @@ void RandSpgOptions::interpretLineAndSetOption(string line)
     }
     m_verbosity = value[0];
   }
+  else if (option == "seed") {
+    m_seed = stoull(value);
+  }
+  else if (option == "numThreads") {
+    m_numThreads = stoi(value);
+  }
+  else if (option == "backtrackDepth") {
+    m_backtrackDepth = stoi(value);
+  }
+  else if (option == "backtrackRetries") {
+    m_backtrackRetries = stoi(value);
+  }
+  else if (option == "placeByDifficulty") {
+    if (value[0] == 'F' || value[0] == 'f')
+      m_placeByDifficulty = false;
+    else if (value[0] == 'T' || value[0] == 't')
+      m_placeByDifficulty = true;
+    else {
+      cerr << "Error reading 'placeByDifficulty' setting: " << value
+           << "\nValid settings are 'True' or 'False' or 'T' or 'F'\n";
+      cerr << "The value will remain the default: false\n";
+    }
+  }
   else {
     cerr << "Warning: the following line contained an unrecognizable option: "
          << line << "\n";
@@ -401,6 +429,15 @@ string RandSpgOptions::getOptionsString() const
   s << "maxAttempts: " << m_maxAttempts << "\n";
   s << "outputDir: " << m_outputDir << "\n";
   s << "output verbosity: " << m_verbosity << "\n";
+  if (m_seed == 0) s << "seed: none\n";
+  else s << "seed: " << m_seed << "\n";
+  if (m_numThreads == 0) s << "numThreads: all available\n";
+  else s << "numThreads: " << m_numThreads << "\n";
+  if (m_backtrackDepth == 0) s << "backtrackDepth: off\n";
+  else s << "backtrackDepth: " << m_backtrackDepth << "\n"
+         << "backtrackRetries: " << m_backtrackRetries << "\n";
+  s << "placeByDifficulty: " << (m_placeByDifficulty ? "true" : "false")
+    << "\n";
   s << "\n";
   return s.str();
 }
@@ -0,0 +1,208 @@
+/**********************************************************************
+  systemPossibilityCache.cpp - Static class for sharing the system
+                               possibilities of a spacegroup and
+                               composition between calls
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "systemPossibilityCache.h"
+
+using namespace std;
+
+// Everything that the possibilities depend on
+struct samplerKey {
+  uint spg;
+  // The number of atoms of each atom type
+  vector<uint> counts;
+  // <atom type index, wyckLet, minNumUses>, sorted
+  vector<tuple<uint, char, uint>> forced;
+  bool forceMostGeneralWyckPos;
+
+  bool operator<(const samplerKey& other) const
+  {
+    return tie(spg, counts, forced, forceMostGeneralWyckPos) <
+           tie(other.spg, other.counts, other.forced,
+               other.forceMostGeneralWyckPos);
+  }
+};
+
+typedef list<samplerKey> usageList;
+
+struct cacheEntry {
+  shared_ptr<const SystemPossibilitySampler> sampler;
+  // Where the key is in the usage list
+  usageList::iterator usage;
+};
+
+// The cache itself. The usage list has the most recently used key first.
+struct samplerCache {
+  mutex lock;
+  map<samplerKey, cacheEntry> entries;
+  usageList usage;
+  size_t maxSize;
+
+  samplerCache() : lock(), entries(), usage(), maxSize(256) {}
+
+  // Removes the least recently used entries until there are at most
+  // maxSize of them. The lock must be held.
+  void trim()
+  {
+    while (entries.size() > maxSize) {
+      entries.erase(usage.back());
+      usage.pop_back();
+    }
+  }
+};
+
+static samplerCache& getCache()
+{
+  // The initialization is thread-safe
+  static samplerCache cache;
+  return cache;
+}
+
+static samplerKey createKey(
+             uint spg,
+             const vector<numAndType>& numOfEachType,
+             const vector<tuple<uint, char, uint>>& forcedWyckAssignments,
+             bool forceMostGeneralWyckPos)
+{
+  samplerKey key;
+  key.spg = spg;
+  key.forceMostGeneralWyckPos = forceMostGeneralWyckPos;
+  for (size_t i = 0; i < numOfEachType.size(); i++)
+    key.counts.push_back(numOfEachType[i].first);
+
+  for (size_t i = 0; i < forcedWyckAssignments.size(); i++) {
+    // Use the index of the atom type. If it is not in the composition, this
+    // is one past the last index, which can never be satisfied.
+    uint atomicNum = get<0>(forcedWyckAssignments[i]);
+    uint typeIndex = 0;
+    while (typeIndex < numOfEachType.size() &&
+           numOfEachType[typeIndex].second != atomicNum) {
+      typeIndex++;
+    }
+    key.forced.push_back(make_tuple(typeIndex,
+                                    get<1>(forcedWyckAssignments[i]),
+                                    get<2>(forcedWyckAssignments[i])));
+  }
+  sort(key.forced.begin(), key.forced.end());
+  return key;
+}
+
+static shared_ptr<const SystemPossibilitySampler>
+createSampler(const samplerKey& key)
+{
+  vector<numAndType> numOfEachType;
+  for (size_t i = 0; i < key.counts.size(); i++)
+    numOfEachType.push_back(make_pair(key.counts[i], i));
+
+  shared_ptr<SystemPossibilitySampler> sampler =
+    make_shared<SystemPossibilitySampler>(key.spg, numOfEachType);
+
+  if (key.forceMostGeneralWyckPos) sampler->requireGeneralWyckPos();
+
+  for (size_t i = 0; i < key.forced.size(); i++) {
+    sampler->requireWyckPos(get<0>(key.forced[i]), get<1>(key.forced[i]),
+                            get<2>(key.forced[i]));
+  }
+
+  // Find all of the counts now. After this, the sampler does not change.
+  sampler->getNumPossibilities();
+  return sampler;
+}
+
+shared_ptr<const SystemPossibilitySampler>
+SystemPossibilityCache::getSampler(
+                 uint spg,
+                 const vector<numAndType>& numOfEachType,
+                 const vector<tuple<uint, char, uint>>& forcedWyckAssignments,
+                 bool forceMostGeneralWyckPos)
+{
+  samplerKey key = createKey(spg, numOfEachType, forcedWyckAssignments,
+                             forceMostGeneralWyckPos);
+
+  samplerCache& cache = getCache();
+  {
+    lock_guard<mutex> guard(cache.lock);
+    map<samplerKey, cacheEntry>::iterator it = cache.entries.find(key);
+    if (it != cache.entries.end()) {
+      // Move it to the front of the usage list
+      cache.usage.splice(cache.usage.begin(), cache.usage, it->second.usage);
+      return it->second.sampler;
+    }
+  }
+
+  // Create it without holding the lock, since it may take a while. If
+  // another thread creates the same one in the meantime, we use theirs.
+  shared_ptr<const SystemPossibilitySampler> sampler = createSampler(key);
+
+  lock_guard<mutex> guard(cache.lock);
+  map<samplerKey, cacheEntry>::iterator it = cache.entries.find(key);
+  if (it != cache.entries.end()) {
+    cache.usage.splice(cache.usage.begin(), cache.usage, it->second.usage);
+    return it->second.sampler;
+  }
+
+  if (cache.maxSize == 0) return sampler;
+
+  cache.usage.push_front(key);
+  cacheEntry entry;
+  entry.sampler = sampler;
+  entry.usage = cache.usage.begin();
+  cache.entries[key] = entry;
+  cache.trim();
+  return sampler;
+}
+
+void SystemPossibilityCache::relabel(systemPossibility& pos,
+                                     const vector<numAndType>& numOfEachType)
+{
+  for (size_t i = 0; i < pos.size(); i++)
+    pos[i].atomicNum = numOfEachType[pos[i].atomicNum].second;
+}
+
+void SystemPossibilityCache::setMaxSize(size_t maxSize)
+{
+  samplerCache& cache = getCache();
+  lock_guard<mutex> guard(cache.lock);
+  cache.maxSize = maxSize;
+  cache.trim();
+}
+
+size_t SystemPossibilityCache::getMaxSize()
+{
+  samplerCache& cache = getCache();
+  lock_guard<mutex> guard(cache.lock);
+  return cache.maxSize;
+}
+
+size_t SystemPossibilityCache::size()
+{
+  samplerCache& cache = getCache();
+  lock_guard<mutex> guard(cache.lock);
+  return cache.entries.size();
+}
+
+void SystemPossibilityCache::clear()
+{
+  samplerCache& cache = getCache();
+  lock_guard<mutex> guard(cache.lock);
+  cache.entries.clear();
+  cache.usage.clear();
+}
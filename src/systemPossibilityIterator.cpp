@@ -0,0 +1,126 @@
+/**********************************************************************
+  systemPossibilityIterator.cpp - Class for walking through the system
+                                  possibilities of a spacegroup and
+                                  composition one at a time
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include "systemPossibilityIterator.h"
+
+using namespace std;
+
+SystemPossibilityIterator::SystemPossibilityIterator(
+                                  const SystemPossibilitySampler& sampler,
+                                  double index) :
+  m_sampler(sampler),
+  m_numPossibilities(sampler.getNumPossibilities()),
+  m_index(0),
+  m_choices(),
+  m_states(),
+  m_current(),
+  m_filters()
+{
+  seek(index);
+}
+
+void SystemPossibilityIterator::addFilter(const filter& f)
+{
+  m_filters.push_back(f);
+  skipFiltered();
+}
+
+bool SystemPossibilityIterator::chooseUsage(size_t typeIndex,
+                                            size_t usageIndex)
+{
+  const vector<SystemPossibilitySampler::groupUsage>& usages =
+    m_sampler.m_usages[typeIndex];
+  for (size_t i = usageIndex; i < usages.size(); i++) {
+    uint64_t nextState;
+    if (!m_sampler.canUse(typeIndex, i, m_states[typeIndex], nextState))
+      continue;
+    if (m_sampler.countCompletions(typeIndex + 1, nextState) == 0.0)
+      continue;
+
+    m_choices[typeIndex] = i;
+    m_states[typeIndex + 1] = nextState;
+    m_current[typeIndex] =
+      m_sampler.createSingleAtomPossibility(typeIndex, i);
+    return true;
+  }
+  return false;
+}
+
+void SystemPossibilityIterator::advance()
+{
+  if (atEnd()) return;
+
+  ++m_index;
+  if (atEnd()) return;
+
+  // Find the last atom type that can move on to another usage. Every
+  // atom type after it starts over at its first usage that can be finished,
+  // which always exists since we only choose usages that can be finished.
+  for (size_t i = m_choices.size(); i-- > 0;) {
+    if (!chooseUsage(i, m_choices[i] + 1)) continue;
+    for (size_t j = i + 1; j < m_choices.size(); j++) chooseUsage(j, 0);
+    return;
+  }
+
+  // Should not happen since the index is not at the end
+  m_index = m_numPossibilities;
+}
+
+bool SystemPossibilityIterator::passesFilters() const
+{
+  for (size_t i = 0; i < m_filters.size(); i++) {
+    if (!m_filters[i](m_current)) return false;
+  }
+  return true;
+}
+
+void SystemPossibilityIterator::skipFiltered()
+{
+  while (!atEnd() && !passesFilters()) advance();
+}
+
+void SystemPossibilityIterator::next()
+{
+  advance();
+  skipFiltered();
+}
+
+void SystemPossibilityIterator::seek(double index)
+{
+  m_index = index;
+  if (atEnd() || !m_sampler.findChoices(index, m_choices, m_states)) {
+    m_index = m_numPossibilities;
+    m_current.clear();
+    return;
+  }
+
+  m_current.clear();
+  for (size_t i = 0; i < m_choices.size(); i++)
+    m_current.push_back(m_sampler.createSingleAtomPossibility(i,
+                                                              m_choices[i]));
+  skipFiltered();
+}
+
+void SystemPossibilityIterator::skip(double num)
+{
+  if (m_filters.empty()) {
+    seek(m_index + num);
+    return;
+  }
+
+  for (double i = 0; i < num && !atEnd(); i++) next();
+}
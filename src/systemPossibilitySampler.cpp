@@ -0,0 +1,336 @@
+/**********************************************************************
+  systemPossibilitySampler.cpp - Class for counting the system possibilities
+                                 of a spacegroup and composition, and for
+                                 picking one of them, without having to
+                                 create all of them
+
+  Copyright (C) 2026 by the RandSpg contributors
+
+  This source code is released under the New BSD License, (the "License").
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+ ***********************************************************************/
+
+#include <climits>
+#include <cmath>
+
+#include "rng.h"
+#include "systemPossibilitySampler.h"
+
+using namespace std;
+
+SystemPossibilitySampler::SystemPossibilitySampler(uint spg,
+                                                   const vector<uint>& atoms) :
+  SystemPossibilitySampler(spg, RandSpg::getNumOfEachType(atoms))
+{
+}
+
+SystemPossibilitySampler::SystemPossibilitySampler(
+                                      uint spg,
+                                      const vector<numAndType>& numOfEachType) :
+  m_groups(),
+  m_types(numOfEachType),
+  m_usages(),
+  m_minUsages(),
+  m_generalGroup(-1),
+  m_requireGeneral(false),
+  m_excludeUnique(false),
+  m_impossible(false),
+  m_masks(),
+  m_generalUsableFrom(),
+  m_initialState(0),
+  m_guardMask(0),
+  m_counts()
+{
+  const vector<similarWyckPositions>& similar =
+    RandSpgCombinatorics::getSimilarWyckPositions(spg);
+
+  // The first bit of the state is for the general position. The fields of
+  // the unique groups follow it. No spacegroup needs more than a few bits.
+  uint shift = 1;
+  for (size_t i = 0; i < similar.size(); i++) {
+    wyckGroup group;
+    group.positions = similar[i];
+    group.multiplicity = RandSpg::getMultiplicity(similar[i][0]);
+    group.unique = RandSpg::containsUniquePosition(similar[i][0]);
+    group.shift = shift;
+    if (group.unique) {
+      // Enough bits for the number of positions, plus the top bit
+      uint64_t numPositions = group.positions.size();
+      uint width = 1;
+      while ((uint64_t(1) << (width - 1)) <= numPositions) width++;
+      uint64_t bias = (uint64_t(1) << (width - 1)) - 1 - numPositions;
+      m_initialState |= bias << shift;
+      m_guardMask |= uint64_t(1) << (shift + width - 1);
+      shift += width;
+    }
+    m_groups.push_back(group);
+  }
+
+  // The most general position is the last one
+  const wyckoffPositions& wyckPositions = RandSpg::getWyckoffPositions(spg);
+  if (!wyckPositions.empty())
+    m_generalGroup = getGroupIndex(RandSpg::getWyckLet(wyckPositions.back()));
+
+  m_usages.resize(m_types.size());
+  m_minUsages.assign(m_types.size(), groupUsage(m_groups.size(), 0));
+  for (size_t i = 0; i < m_types.size(); i++) createUsages(i);
+  createMasks();
+}
+
+void SystemPossibilitySampler::findAllUsages(vector<groupUsage>& usages,
+                                             groupUsage& usage,
+                                             const groupUsage& minUsage,
+                                             size_t firstAvailable,
+                                             uint numAtomsLeft,
+                                             uint numAtomsReserved) const
+{
+  if (numAtomsLeft < numAtomsReserved) return;
+  if (numAtomsLeft == 0 || firstAvailable >= m_groups.size()) return;
+
+  const wyckGroup& group = m_groups[firstAvailable];
+  uint& numUses = usage[firstAvailable];
+
+  // Use this group (again, if it has already been used) if we can
+  if (group.multiplicity <= numAtomsLeft &&
+      (!group.unique ||
+       (!m_excludeUnique && numUses < group.positions.size()))) {
+    uint nextReserved = numAtomsReserved;
+    if (numUses < minUsage[firstAvailable])
+      nextReserved -= group.multiplicity;
+    numUses++;
+    if (numAtomsLeft == group.multiplicity) {
+      if (nextReserved == 0) usages.push_back(usage);
+    }
+    else {
+      findAllUsages(usages, usage, minUsage, firstAvailable,
+                    numAtomsLeft - group.multiplicity, nextReserved);
+    }
+    numUses--;
+  }
+
+  // And find all of the usages that do not use it (again). It cannot be
+  // left behind until it has been used enough.
+  if (numUses >= minUsage[firstAvailable]) {
+    findAllUsages(usages, usage, minUsage, firstAvailable + 1, numAtomsLeft,
+                  numAtomsReserved);
+  }
+}
+
+void SystemPossibilitySampler::createUsages(size_t typeIndex)
+{
+  const groupUsage& minUsage = m_minUsages[typeIndex];
+  uint numAtomsReserved = 0;
+  for (size_t i = 0; i < m_groups.size(); i++)
+    numAtomsReserved += minUsage[i] * m_groups[i].multiplicity;
+
+  vector<groupUsage>& usages = m_usages[typeIndex];
+  usages.clear();
+  groupUsage usage(m_groups.size(), 0);
+  findAllUsages(usages, usage, minUsage, 0, m_types[typeIndex].first,
+                numAtomsReserved);
+}
+
+int SystemPossibilitySampler::getGroupIndex(char wyckLet) const
+{
+  for (size_t i = 0; i < m_groups.size(); i++) {
+    const similarWyckPositions& positions = m_groups[i].positions;
+    for (size_t j = 0; j < positions.size(); j++) {
+      if (RandSpg::getWyckLet(positions[j]) == wyckLet) return i;
+    }
+  }
+  return -1;
+}
+
+void SystemPossibilitySampler::clearCounts() const
+{
+  m_counts.clear();
+}
+
+void SystemPossibilitySampler::requireGeneralWyckPos()
+{
+  if (m_generalGroup == -1) m_impossible = true;
+  m_requireGeneral = true;
+  clearCounts();
+}
+
+void SystemPossibilitySampler::requireWyckPos(uint atomicNum, char wyckLet,
+                                              uint minNumUses)
+{
+  if (minNumUses == 0) return;
+
+  clearCounts();
+
+  size_t typeIndex = 0;
+  while (typeIndex < m_types.size() && m_types[typeIndex].second != atomicNum)
+    typeIndex++;
+  int groupIndex = getGroupIndex(wyckLet);
+
+  if (typeIndex == m_types.size() || groupIndex == -1) {
+    m_impossible = true;
+    return;
+  }
+
+  // A unique Wyckoff position counts as being usable once if its group is
+  // used at all. So it can never be used more than once.
+  if (m_groups[groupIndex].unique) {
+    if (minNumUses > 1) m_impossible = true;
+    minNumUses = 1;
+  }
+
+  uint& minUsage = m_minUsages[typeIndex][groupIndex];
+  if (minUsage >= minNumUses) return;
+  minUsage = minNumUses;
+  createUsages(typeIndex);
+  createMasks();
+}
+
+void SystemPossibilitySampler::excludeUniqueWyckPos()
+{
+  clearCounts();
+  m_excludeUnique = true;
+  for (size_t i = 0; i < m_types.size(); i++) createUsages(i);
+  createMasks();
+}
+
+void SystemPossibilitySampler::createMasks()
+{
+  m_masks.resize(m_usages.size());
+  m_generalUsableFrom.assign(m_usages.size() + 1, false);
+  for (size_t i = 0; i < m_usages.size(); i++) {
+    const vector<groupUsage>& usages = m_usages[i];
+    vector<usageMask>& masks = m_masks[i];
+    masks.resize(usages.size());
+    for (size_t j = 0; j < usages.size(); j++) {
+      usageMask& mask = masks[j];
+      mask = 0;
+      for (size_t k = 0; k < m_groups.size(); k++) {
+        uint numUses = usages[j][k];
+        if (numUses == 0) continue;
+        if (m_groups[k].unique)
+          mask += uint64_t(numUses) << m_groups[k].shift;
+        if (static_cast<int>(k) == m_generalGroup) mask |= 1;
+      }
+      if (mask & 1) m_generalUsableFrom[i] = true;
+    }
+  }
+  for (size_t i = m_usages.size(); i-- > 0;) {
+    if (m_generalUsableFrom[i + 1]) m_generalUsableFrom[i] = true;
+  }
+}
+
+double SystemPossibilitySampler::countCompletions(size_t typeIndex,
+                                                  uint64_t state) const
+{
+  if (m_requireGeneral && !(state & 1) && !m_generalUsableFrom[typeIndex])
+    return 0.0;
+  if (typeIndex == m_types.size()) return 1.0;
+
+  if (m_counts.size() != m_types.size()) m_counts.resize(m_types.size());
+  unordered_map<uint64_t, double>& counts = m_counts[typeIndex];
+  unordered_map<uint64_t, double>::const_iterator it = counts.find(state);
+  if (it != counts.end()) return it->second;
+
+  double count = 0.0;
+  const vector<groupUsage>& usages = m_usages[typeIndex];
+  for (size_t i = 0; i < usages.size(); i++) {
+    uint64_t nextState;
+    if (canUse(typeIndex, i, state, nextState))
+      count += countCompletions(typeIndex + 1, nextState);
+  }
+  counts[state] = count;
+  return count;
+}
+
+double SystemPossibilitySampler::getNumPossibilities() const
+{
+  if (m_impossible || m_types.empty()) return 0.0;
+  return countCompletions(0, m_initialState);
+}
+
+bool SystemPossibilitySampler::findChoices(double index,
+                                           vector<size_t>& choices,
+                                           vector<uint64_t>& states) const
+{
+  choices.clear();
+  states.clear();
+  if (getNumPossibilities() == 0.0) return false;
+
+  uint64_t state = m_initialState;
+  states.push_back(state);
+  for (size_t i = 0; i < m_types.size(); i++) {
+    const vector<groupUsage>& usages = m_usages[i];
+    // Skip over all of the possibilities that come before the index
+    size_t chosen = usages.size();
+    uint64_t chosenState = state;
+    for (size_t j = 0; j < usages.size(); j++) {
+      uint64_t nextState;
+      if (!canUse(i, j, state, nextState)) continue;
+      double count = countCompletions(i + 1, nextState);
+      if (count == 0.0) continue;
+      // If the index is too large, we end up with the last one
+      chosen = j;
+      chosenState = nextState;
+      if (index < count) break;
+      index -= count;
+    }
+
+    // Should not happen since there is at least one possibility
+    if (chosen == usages.size()) return false;
+
+    choices.push_back(chosen);
+    states.push_back(chosenState);
+    state = chosenState;
+  }
+  return true;
+}
+
+singleAtomPossibility
+SystemPossibilitySampler::createSingleAtomPossibility(size_t typeIndex,
+                                                      size_t usageIndex) const
+{
+  const groupUsage& usage = m_usages[typeIndex][usageIndex];
+  singleAtomPossibility poss;
+  poss.atomicNum = m_types[typeIndex].second;
+  for (size_t i = 0; i < m_groups.size(); i++) {
+    if (usage[i] == 0) continue;
+    similarWyckPosAndNumToChoose temp;
+    temp.numToChoose = usage[i];
+    temp.choosablePositions = m_groups[i].positions;
+    poss.assigns.push_back(temp);
+  }
+  return poss;
+}
+
+systemPossibility SystemPossibilitySampler::getPossibility(double index) const
+{
+  systemPossibility ret;
+  vector<size_t> choices;
+  vector<uint64_t> states;
+  if (!findChoices(index, choices, states)) return ret;
+
+  for (size_t i = 0; i < choices.size(); i++)
+    ret.push_back(createSingleAtomPossibility(i, choices[i]));
+  return ret;
+}
+
+systemPossibility SystemPossibilitySampler::getRandomPossibility() const
+{
+  double num = getNumPossibilities();
+  if (num == 0.0) return systemPossibility();
+  return getPossibility(getRandomIndex(num));
+}
+
+double SystemPossibilitySampler::getRandomIndex(double num) const
+{
+  // This is the same as picking a random element of the vector of all
+  // possibilities. If there are more than fit in an int, the index is
+  // drawn from a double instead.
+  if (num <= INT_MAX) return getRandInt(0, static_cast<int>(num) - 1);
+  return floor(getRandDouble(0.0, num));
+}
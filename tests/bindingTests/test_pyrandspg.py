@@ -24,3 +24,164 @@ class TestPyrandspg(unittest.TestCase):
         self.assertEqual(self.lattice.alpha, 60.0)
         self.assertEqual(self.lattice.beta, 70.0)
         self.assertEqual(self.lattice.gamma, 80.0)
+
+    def makeInput(self, spg):
+
+        # Ti2O4 in a cell that leaves plenty of room for it
+        mins = pyrandspg.LatticeStruct(3.0, 3.0, 3.0, 60.0, 60.0, 60.0)
+        maxes = pyrandspg.LatticeStruct(10.0, 10.0, 10.0, 120.0, 120.0, 120.0)
+        inp = pyrandspg.RandSpgInput(spg, [22, 22, 8, 8, 8, 8], mins, maxes)
+        inp.IADScalingFactor = 0.5
+        return inp
+
+    def assertCrystalsEqual(self, c1, c2):
+
+        l1 = c1.getLattice()
+        l2 = c2.getLattice()
+        self.assertEqual((l1.a, l1.b, l1.c, l1.alpha, l1.beta, l1.gamma),
+                         (l2.a, l2.b, l2.c, l2.alpha, l2.beta, l2.gamma))
+        self.assertEqual([(a.atomicNum, a.x, a.y, a.z) for a in c1.getAtoms()],
+                         [(a.atomicNum, a.x, a.y, a.z) for a in c2.getAtoms()])
+
+    def test_seededCrystalsAreReproducible(self):
+
+        for spg in [1, 2, 14]:
+            inp = self.makeInput(spg)
+            inp.seed = 12345
+            c1 = pyrandspg.RandSpg.randSpgCrystal(inp)
+            c2 = pyrandspg.RandSpg.randSpgCrystal(inp)
+            self.assertGreater(c1.getVolume(), 0.0)
+            self.assertEqual(c1.numAtoms(), 6)
+            self.assertCrystalsEqual(c1, c2)
+
+            # Another structure index draws from another stream
+            inp.structureIndex = 1
+            c3 = pyrandspg.RandSpg.randSpgCrystal(inp)
+            self.assertNotEqual(c1.getLattice().a, c3.getLattice().a)
+
+    def test_getPossibleSpacegroups(self):
+
+        compositions = [[22, 8, 8], [22] * 4 + [8] * 8, [11, 17], [6]]
+        for atoms in compositions:
+            possible = pyrandspg.RandSpg.getPossibleSpacegroups(atoms)
+            for spg in range(1, 231):
+                self.assertEqual(spg in possible,
+                                 pyrandspg.RandSpg.isSpgPossible(spg, atoms))
+
+    def test_compileAndGenerate(self):
+
+        for spg in [1, 2, 14]:
+            inp = self.makeInput(spg)
+            plan = pyrandspg.RandSpg.compile(inp)
+            self.assertTrue(plan.isValid())
+            self.assertGreater(plan.getNumPossibilities(), 0)
+            crystals = plan.generate(5)
+            self.assertEqual(len(crystals), 5)
+            for crystal in crystals:
+                self.assertGreater(crystal.getVolume(), 0.0)
+                self.assertEqual(crystal.numAtoms(), 6)
+
+            # Structure i of a seeded plan is the crystal that the input
+            # gives with structure index i
+            inp.seed = 12345
+            crystals = pyrandspg.RandSpg.compile(inp).generate(3)
+            for i in range(3):
+                inp.structureIndex = i
+                self.assertCrystalsEqual(
+                    crystals[i], pyrandspg.RandSpg.randSpgCrystal(inp))
+
+        # Ti2O4 fits in spacegroup 136 (rutile has Ti on 2a and O on 4f),
+        # but only without the most general position
+        inp = self.makeInput(136)
+        self.assertFalse(pyrandspg.RandSpg.compile(inp).isValid())
+        inp.forceMostGeneralWyckPos = False
+        self.assertTrue(pyrandspg.RandSpg.compile(inp).isValid())
+
+    def test_backtracking(self):
+
+        inp = self.makeInput(1)
+        self.assertEqual(inp.backtrackDepth, 0)
+        self.assertEqual(inp.backtrackRetries, 3)
+
+        # Ti4O8 in a small cell with a single attempt per crystal, so that
+        # many crystals fail without backtracking
+        mins = pyrandspg.LatticeStruct(3.0, 3.0, 3.0, 60.0, 60.0, 60.0)
+        maxes = pyrandspg.LatticeStruct(6.0, 6.0, 6.0, 120.0, 120.0, 120.0)
+        for spg in [1, 2, 14]:
+            inp = pyrandspg.RandSpgInput(spg, [22] * 4 + [8] * 8, mins, maxes)
+            inp.IADScalingFactor = 0.6
+            inp.maxAttempts = 1
+            inp.seed = 12345
+            without = pyrandspg.RandSpg.compile(inp).generate(20)
+            inp.backtrackDepth = 4
+            backtracked = pyrandspg.RandSpg.compile(inp).generate(20)
+
+            # Every attempt draws the same lattice and assignments either
+            # way, and backtracking only starts after a failure. So each
+            # crystal that succeeded without it is unchanged, and some that
+            # failed must succeed with it.
+            numWithout = 0
+            numBacktracked = 0
+            for crystal, other in zip(without, backtracked):
+                if crystal.getVolume() > 0.0:
+                    numWithout += 1
+                    self.assertCrystalsEqual(crystal, other)
+                if other.getVolume() > 0.0:
+                    numBacktracked += 1
+                    self.assertEqual(other.numAtoms(), 12)
+            self.assertGreater(numBacktracked, numWithout)
+
+    def getPlacementOrders(self, inp):
+
+        # The atom assignments of every attempt are logged in the order in
+        # which they are placed when the verbosity is 'r'
+        log = []
+        context = pyrandspg.RandSpgContext(inp)
+        context.setLogSink(log.append)
+        pyrandspg.RandSpg.compile(inp, context).generate(10, context)
+
+        positions = {}
+        for pos in pyrandspg.RandSpg.getWyckoffPositions(inp.spg):
+            positions[pos[0]] = pos
+
+        orders = []
+        for text in log:
+            if not text.startswith("printing atom assignments:"):
+                continue
+            # Unique positions first, then by multiplicity times the cube of
+            # the radius
+            difficulties = []
+            for line in text.splitlines()[2:]:
+                atomicNum, letter = line.split(" : ")
+                letter, multiplicity, coords, unique = positions[letter]
+                if unique:
+                    difficulties.append(float("inf"))
+                else:
+                    radius = context.getRadius(int(atomicNum))
+                    difficulties.append(multiplicity * radius ** 3)
+            orders.append(difficulties)
+        return orders
+
+    def test_placeByDifficulty(self):
+
+        inp = self.makeInput(1)
+        self.assertFalse(inp.placeByDifficulty)
+
+        for spg in [2, 14]:
+            inp = self.makeInput(spg)
+            inp.atoms = [22] * 4 + [8] * 8
+            inp.seed = 12345
+            inp.verbosity = 'r'
+
+            # The order of the assignments does not follow the difficulty
+            # by itself
+            orders = self.getPlacementOrders(inp)
+            self.assertTrue(orders)
+            self.assertTrue(any(order != sorted(order, reverse=True)
+                                for order in orders))
+
+            inp.placeByDifficulty = True
+            orders = self.getPlacementOrders(inp)
+            self.assertTrue(orders)
+            for order in orders:
+                self.assertEqual(order, sorted(order, reverse=True))